@@ -0,0 +1,203 @@
+// Headless benchmark of terrain generation, meshing and grid marching.
+// Runs without a window or OpenGL context on a fixed seed and region, and
+// prints one JSON object, so results can be compared between builds:
+//   bench [--seed N] [--radius CHUNKS] [--rays N] [--repeat N] [--out FILE]
+#include "scene/terrain.h"
+#include "scene/player.h"
+#include "simd.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Peak resident set size of the process in bytes, or -1 if unknown
+long long peakRssBytes() {
+#if defined(__APPLE__)
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<long long>(usage.ru_maxrss) : -1;
+#elif defined(__unix__)
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<long long>(usage.ru_maxrss) * 1024 : -1;
+#else
+    return -1;
+#endif
+}
+
+struct Options {
+    uint32_t seed = 1;
+    int radius = 8;      // The region is 2 * radius Chunks on a side, centered on the origin
+    int rays = 200000;
+    int repeat = 3;      // Meshing passes over the region; the fastest counts
+    std::string out;     // Empty writes to stdout
+};
+
+bool parseOptions(int argc, char **argv, Options &o) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--seed") {
+            o.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--radius") {
+            o.radius = std::max(2, std::atoi(value));
+        } else if (arg == "--rays") {
+            o.rays = std::max(1, std::atoi(value));
+        } else if (arg == "--repeat") {
+            o.repeat = std::max(1, std::atoi(value));
+        } else if (arg == "--out") {
+            o.out = value;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct MeshResult {
+    double seconds = 0;
+    size_t quads = 0, vertices = 0, bytes = 0;
+};
+
+// Remeshes every Chunk of the region from scratch, repeat times
+MeshResult benchMeshing(std::vector<Chunk*> &chunks, bool greedy, int repeat) {
+    Chunk::greedyMeshing = greedy;
+    MeshResult best;
+    for (int r = 0; r < repeat; r++) {
+        MeshResult result;
+        for (Chunk *c : chunks) {
+            ChunkVBOData data;
+            c->invalidateMesh();
+            Clock::time_point start = Clock::now();
+            c->buildVBOdata(data);
+            result.seconds += secondsSince(start);
+            size_t verts = data.d.size() + data.d_trans.size();
+            result.vertices += verts;
+            result.quads += verts / 4;
+            result.bytes += verts * sizeof(ChunkVertex);
+        }
+        if (r == 0 || result.seconds < best.seconds) {
+            best = result;
+        }
+    }
+    return best;
+}
+
+void writeMeshJson(std::ostream &out, const char *name, const MeshResult &m, size_t chunks) {
+    out << "    \"" << name << "\": {\"chunks_per_s\": " << chunks / m.seconds
+        << ", \"faces_per_s\": " << m.quads / m.seconds
+        << ", \"faces\": " << m.quads
+        << ", \"bytes_per_vertex\": " << double(m.bytes) / std::max<size_t>(m.vertices, 1)
+        << ", \"vertex_bytes_per_vertex\": " << sizeof(ChunkVertex) << "}";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "usage: bench [--seed N] [--radius CHUNKS] [--rays N] [--repeat N] [--out FILE]\n";
+        return 2;
+    }
+    const int minBlock = -16 * options.radius, maxBlock = 16 * options.radius;
+
+    // No context: nothing here may reach OpenGL
+    Terrain terrain(nullptr);
+    terrain.setNoiseSettings(NoiseSettings{NOISE_INTEGER_HASH, options.seed});
+    std::vector<Chunk*> chunks;
+    for (int x = minBlock; x < maxBlock; x += 16) {
+        for (int z = minBlock; z < maxBlock; z += 16) {
+            chunks.push_back(terrain.instantiateChunkAt(x, z));
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+    for (Chunk *c : chunks) {
+        terrain.generateBlocks(c);
+    }
+    double generateSeconds = secondsSince(start);
+    size_t blockBytes = 0;
+    for (Chunk *c : chunks) {
+        blockBytes += c->blockBytes();
+    }
+
+    MeshResult faces = benchMeshing(chunks, false, options.repeat);
+    MeshResult greedy = benchMeshing(chunks, true, options.repeat);
+
+    // Rays of up to 32 blocks from random points above the ground, far
+    // enough inside the region that they never leave it
+    std::mt19937 rng(options.seed);
+    std::uniform_real_distribution<float> horizontal(minBlock + 33.f, maxBlock - 33.f);
+    std::uniform_real_distribution<float> height(130.f, 220.f);
+    std::uniform_real_distribution<float> component(-1.f, 1.f);
+    std::vector<std::pair<glm::vec3, glm::vec3>> rays(options.rays);
+    for (auto &[origin, direction] : rays) {
+        origin = glm::vec3(horizontal(rng), height(rng), horizontal(rng));
+        do {
+            direction = glm::vec3(component(rng), component(rng), component(rng));
+        } while (glm::length(direction) < 0.1f);
+        direction = 32.f * glm::normalize(direction);
+    }
+    int hits = 0, errors = 0;
+    start = Clock::now();
+    for (auto &[origin, direction] : rays) {
+        float dist;
+        glm::ivec3 block;
+        // gridMarch gives up on some rays that run exactly along a cell edge
+        try {
+            hits += gridMarch(origin, direction, terrain, &dist, &block);
+        } catch (const std::out_of_range&) {
+            errors++;
+        }
+    }
+    double marchSeconds = secondsSince(start);
+
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"seed\": " << options.seed << ",\n"
+         << "  \"chunks\": " << chunks.size() << ",\n"
+         << "  \"simd_lanes\": " << SIMD_LANES << ",\n"
+         << "  \"generate\": {\"chunks_per_s\": " << chunks.size() / generateSeconds
+         << ", \"block_bytes_per_chunk\": " << blockBytes / chunks.size() << "},\n"
+         << "  \"mesh\": {\n";
+    writeMeshJson(json, "faces", faces, chunks.size());
+    json << ",\n";
+    writeMeshJson(json, "greedy", greedy, chunks.size());
+    json << "\n  },\n"
+         << "  \"grid_march\": {\"rays_per_s\": " << rays.size() / marchSeconds
+         << ", \"hit_fraction\": " << double(hits) / rays.size()
+         << ", \"errors\": " << errors << "},\n"
+         << "  \"peak_rss_bytes\": " << peakRssBytes() << "\n"
+         << "}\n";
+
+    if (options.out.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(options.out);
+        file << json.str();
+        if (!file) {
+            std::cerr << "could not write " << options.out << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+# Headless benchmark of terrain generation, meshing and grid marching.
+# Links the game's terrain code without mygl, the windows or any shaders,
+# and never creates an OpenGL context. Qt is only needed because Chunk is
+# a Drawable. Build it on its own, e.g.
+#   qmake bench/bench.pro && make && ./bench --out results.json
+QT += core widgets openglwidgets
+
+TARGET = bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++1z
+# Always measure optimized code
+CONFIG -= debug
+CONFIG += release
+win32 {
+    LIBS += -lopengl32
+}
+
+INCLUDEPATH += $$PWD/../include $$PWD/../src $$PWD/../src/scene
+
+*-clang*|*-g++* {
+    # The same floating point behavior as miniMinecraft.pro
+    QMAKE_CXXFLAGS += -ffp-contract=off
+}
+
+SOURCES += \
+    $$PWD/bench.cpp \
+    $$PWD/../src/drawable.cpp \
+    $$PWD/../src/openglcontext.cpp \
+    $$PWD/../src/shaderprogram.cpp \
+    $$PWD/../src/jobsystem.cpp \
+    $$PWD/../src/profiler.cpp \
+    $$PWD/../src/scene/chunk.cpp \
+    $$PWD/../src/scene/chunkarena.cpp \
+    $$PWD/../src/scene/chunkscheduler.cpp \
+    $$PWD/../src/scene/chunkuploadqueue.cpp \
+    $$PWD/../src/scene/cube.cpp \
+    $$PWD/../src/scene/frustum.cpp \
+    $$PWD/../src/scene/caveculler.cpp \
+    $$PWD/../src/scene/noise.cpp \
+    $$PWD/../src/scene/regionfile.cpp \
+    $$PWD/../src/scene/voxelvolume.cpp \
+    $$PWD/../src/scene/terrain.cpp \
+    $$PWD/../src/scene/entity.cpp \
+    $$PWD/../src/scene/camera.cpp \
+    $$PWD/../src/scene/player.cpp
+
+HEADERS += \
+    $$PWD/../src/drawable.h \
+    $$PWD/../src/openglcontext.h \
+    $$PWD/../src/shaderprogram.h \
+    $$PWD/../src/jobsystem.h \
+    $$PWD/../src/profiler.h \
+    $$PWD/../src/simd.h \
+    $$PWD/../src/scene/chunk.h \
+    $$PWD/../src/scene/chunkarena.h \
+    $$PWD/../src/scene/chunkscheduler.h \
+    $$PWD/../src/scene/chunkuploadqueue.h \
+    $$PWD/../src/scene/cube.h \
+    $$PWD/../src/scene/frustum.h \
+    $$PWD/../src/scene/caveculler.h \
+    $$PWD/../src/scene/noise.h \
+    $$PWD/../src/scene/palettedblocks.h \
+    $$PWD/../src/scene/voxelvolume.h \
+    $$PWD/../src/scene/regionfile.h \
+    $$PWD/../src/scene/chunkkey.h \
+    $$PWD/../src/scene/terrain.h \
+    $$PWD/../src/scene/entity.h \
+    $$PWD/../src/scene/camera.h \
+    $$PWD/../src/scene/player.h
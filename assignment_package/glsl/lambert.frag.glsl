@@ -20,18 +20,39 @@ uniform int u_Time; // time
 
 uniform vec3 u_Sun;
 
+uniform int u_NoiseBackend; // 0: sin-fract, 1: integer hash (NoiseBackend in noise.h)
+uniform uint u_Seed;
+
 // These are the interpolated values out of the rasterizer, so you can't know
 // their specific values without knowing the vertices that contributed to them
 in vec4 fs_Pos;
 in vec4 fs_Nor;
-in vec4 fs_LightVec;
 in vec4 fs_Col;
 in vec4 fs_UV;
 
 out vec4 out_Col; // This is the final output color that you will see on your
                   // screen for the pixel that is currently being processed.
 
+// hashLattice() from noise.h, with z as a third coordinate
+uint hashLattice(ivec3 p) {
+    const uint PRIME2 = 2246822519u, PRIME3 = 3266489917u;
+    const uint PRIME4 = 668265263u, PRIME5 = 374761393u;
+    uint h = u_Seed + PRIME5 + 16u;
+    uvec4 words = uvec4(uvec3(p), 0u);
+    for (int i = 0; i < 4; i++) {
+        h += words[i] * PRIME3;
+        h = ((h << 17) | (h >> 15)) * PRIME4;
+    }
+    h = (h ^ (h >> 15)) * PRIME2;
+    h = (h ^ (h >> 13)) * PRIME3;
+    return h ^ (h >> 16);
+}
+
+// p is a lattice point, i.e. its components are integers
 float random1(vec3 p) {
+    if (u_NoiseBackend == 1) {
+        return float(hashLattice(ivec3(p)) >> 8) / 16777216.0;
+    }
     return fract(sin(dot(p,vec3(127.1, 311.7, 191.999)))
                  *43758.5453);
 }
@@ -98,7 +119,9 @@ mat3 LocalToWorld(vec3 nor) {
 void main()
 {
     // Material base color (before shading)
-    vec2 uv = fs_UV.xy;
+    // Wrap the tile-space coordinates so greedy-merged quads repeat the
+    // block's texture once per block
+    vec2 uv = fs_UV.xy + fract(fs_UV.zw) / 16.f;
     // animation of water
     if (length(fs_Col) == length(WATER)) {
         uv.x += (cos(2 * M_PI * (u_Time / 10000.f)) + 1.f) / 16.f;
@@ -119,8 +142,12 @@ void main()
 //    }
     diffuseColor = diffuseColor * (0.5 * fbm(fs_Pos.xyz) + 0.5);
 
+    // The light direction is computed per fragment so a large merged quad
+    // is lit exactly like the unit faces it replaces
+    vec4 lightVec = vec4(u_Sun - fs_Pos.xyz, 0);
+
     // Calculate the diffuse term for Lambert shading
-    float diffuseTerm = dot(normalize(normal), normalize(fs_LightVec));
+    float diffuseTerm = dot(normalize(normal), normalize(lightVec));
     // Avoid negative lighting values
     diffuseTerm = clamp(diffuseTerm, 0, 1);
 
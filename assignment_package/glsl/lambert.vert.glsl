@@ -22,39 +22,80 @@ uniform mat4 u_ViewProj;    // The matrix that defines the camera's transformati
 
 uniform vec4 u_Color;       // When drawing the cube instance, we'll set our uniform color to represent different block types.
 
-uniform vec3 u_Sun;         // The sun center used to calculate the light direction
-
-in vec4 vs_Pos;             // The array of vertex positions passed to the shader
-
-in vec4 vs_Nor;             // The array of vertex normals passed to the shader
-
-in vec4 vs_Col;             // The array of vertex colors passed to the shader.
-
-in vec4 vs_UV;
+in uvec2 vs_Packed;         // One packed terrain vertex, see ChunkVertex in chunk.h:
+                            //   x: chunk-local x (5 bits), y (9 bits), z (5 bits),
+                            //      face Direction (3 bits) and BlockType (8 bits)
+                            //   y: the chunk's origin in units of 16 blocks, x in the
+                            //      low 16 bits and z in the high 16 bits (both signed)
 
 out vec4 fs_Pos;
 out vec4 fs_Nor;            // The array of normals that has been transformed by u_ModelInvTr. This is implicitly passed to the fragment shader.
-out vec4 fs_LightVec;       // The direction in which our virtual light lies, relative to each vertex. This is implicitly passed to the fragment shader.
 out vec4 fs_Col;            // The color of each vertex. This is implicitly passed to the fragment shader.
-out vec4 fs_UV;
-
-const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));  // The direction of our virtual light, which is used to compute the shading of
-                                        // the geometry in the fragment shader.
+out vec4 fs_UV;             // xy: lower-left corner of the block's atlas tile, zw: position across the face in blocks
+
+// Indexed by Direction: XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
+const vec3 normals[6] = vec3[6](vec3(1, 0, 0), vec3(-1, 0, 0),
+                                vec3(0, 1, 0), vec3(0, -1, 0),
+                                vec3(0, 0, 1), vec3(0, 0, -1));
+
+// Indexed by BlockType: EMPTY, GRASS, DIRT, STONE, WATER, SNOW, LAVA, BEDROCK.
+// These and the tiles below must match blockColors and blockTile() in
+// voxelvolume.h, which the Planet's mesher uses.
+const vec3 colors[8] = vec3[8](vec3(1, 0, 1),
+                               vec3(95, 159, 53) / 255.f,
+                               vec3(121, 85, 58) / 255.f,
+                               vec3(0.5),
+                               vec3(0, 0, 0.75),
+                               vec3(1, 1, 1),
+                               vec3(207, 16, 32) / 255.f,
+                               vec3(1, 0, 1));
+
+// Lower-left corner of each BlockType's tile in the 16 x 16 texture atlas.
+// Grass uses a different tile on its top and bottom faces.
+const vec2 tiles[8] = vec2[8](vec2(7, 1), vec2(3, 15), vec2(3, 15), vec2(1, 15),
+                              vec2(13, 3), vec2(2, 11), vec2(13, 1), vec2(7, 1));
+const vec2 grassTop = vec2(8, 13);
+const vec2 grassBottom = vec2(2, 15);
+
+const uint GRASS = 1u;
+const uint YPOS = 2u;
+const uint YNEG = 3u;
+
+vec2 tileOf(uint type, uint face) {
+    if (type == GRASS && face == YPOS) return grassTop;
+    if (type == GRASS && face == YNEG) return grassBottom;
+    return tiles[type];
+}
 
-vec4 LAVA  = vec4(207.f, 16.f, 32.f, 255.f) / 255.f;
+// Position across the face in blocks, running in the same direction as the
+// texture's u and v so the tile appears the same way up on every face
+vec2 faceCoords(vec3 p, uint face) {
+    switch (face) {
+    case 0u: return vec2(p.z, p.y);
+    case 1u: return vec2(-p.z, p.y);
+    case 2u: return vec2(-p.x, -p.z);
+    case 3u: return vec2(-p.x, p.z);
+    case 4u: return vec2(-p.x, p.y);
+    default: return vec2(p.x, p.y);
+    }
+}
 
 void main()
 {
-    vec4 pos = vs_Pos;
-    if (length(vs_Col) == length(LAVA)) {
-        pos += vec4(u_Sun, 0.);
-    }
+    uint bits = vs_Packed.x;
+    vec3 local = vec3(float(bits & 31u), float((bits >> 5u) & 511u), float((bits >> 14u) & 31u));
+    uint face = (bits >> 19u) & 7u;
+    uint type = (bits >> 22u) & 255u;
+    // Sign-extend the two 16 bit halves of the chunk origin
+    ivec2 chunk = ivec2(int(vs_Packed.y << 16u) >> 16, int(vs_Packed.y) >> 16);
+
+    vec4 pos = vec4(local + vec3(chunk.x * 16, 0, chunk.y * 16), 1);
     fs_Pos = pos;
-    fs_Col = vs_Col;                         // Pass the vertex colors to the fragment shader for interpolation
-    fs_UV  = vs_UV;
+    fs_Col = vec4(colors[type], 1);
+    fs_UV  = vec4(tileOf(type, face) / 16.f, faceCoords(local, face));
 
     mat3 invTranspose = mat3(u_ModelInvTr);
-    fs_Nor = vec4(invTranspose * vec3(vs_Nor), 0);          // Pass the vertex normals to the fragment shader for interpolation.
+    fs_Nor = vec4(invTranspose * normals[face], 0);         // Pass the vertex normals to the fragment shader for interpolation.
                                                             // Transform the geometry's normals by the inverse transpose of the
                                                             // model matrix. This is necessary to ensure the normals remain
                                                             // perpendicular to the surface after the surface is transformed by
@@ -62,9 +103,6 @@ void main()
 
     vec4 modelposition = u_Model * pos;   // Temporarily store the transformed vertex positions for use below
 
-    // calculate the light direction
-    fs_LightVec = normalize(vec4(u_Sun - modelposition.xyz, 0));
-
     gl_Position = u_ViewProj * modelposition;// gl_Position is a built-in variable of OpenGL which is
                                              // used to render the final positions of the geometry's vertices
 }
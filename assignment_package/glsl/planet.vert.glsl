@@ -0,0 +1,70 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// Lambert vertex shader for the Planet, whose chunks still use the interleaved
+// 4 x vec4 vertex layout (position, normal, color, UV) and radial normals.
+// Terrain Chunks use the packed layout decoded in lambert.vert.glsl.
+
+//This is a vertex shader. While it is called a "shader" due to outdated conventions, this file
+//is used to apply matrix transformations to the arrays of vertex data passed to it.
+//Since this code is run on your GPU, each vertex is transformed simultaneously.
+//If it were run on your CPU, each vertex would have to be processed in a FOR loop, one at a time.
+//This simultaneous transformation allows your program to run much faster, especially when rendering
+//geometry with millions of vertices.
+
+uniform mat4 u_Model;       // The matrix that defines the transformation of the
+                            // object we're rendering. In this assignment,
+                            // this will be the result of traversing your scene graph.
+
+uniform mat4 u_ModelInvTr;  // The inverse transpose of the model matrix.
+                            // This allows us to transform the object's normals properly
+                            // if the object has been non-uniformly scaled.
+
+uniform mat4 u_ViewProj;    // The matrix that defines the camera's transformation.
+                            // We've written a static matrix for you to use for HW2,
+                            // but in HW3 you'll have to generate one yourself
+
+uniform vec4 u_Color;       // When drawing the cube instance, we'll set our uniform color to represent different block types.
+
+uniform vec3 u_Sun;         // The sun center used to calculate the light direction
+
+in vec4 vs_Pos;             // The array of vertex positions passed to the shader
+
+in vec4 vs_Nor;             // The array of vertex normals passed to the shader
+
+in vec4 vs_Col;             // The array of vertex colors passed to the shader.
+
+in vec4 vs_UV;
+
+out vec4 fs_Pos;
+out vec4 fs_Nor;            // The array of normals that has been transformed by u_ModelInvTr. This is implicitly passed to the fragment shader.
+out vec4 fs_Col;            // The color of each vertex. This is implicitly passed to the fragment shader.
+out vec4 fs_UV;             // xy: lower-left corner of the block's atlas tile, zw: position across the face in blocks
+
+const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));  // The direction of our virtual light, which is used to compute the shading of
+                                        // the geometry in the fragment shader.
+
+vec4 LAVA  = vec4(207.f, 16.f, 32.f, 255.f) / 255.f;
+
+void main()
+{
+    vec4 pos = vs_Pos;
+    if (length(vs_Col) == length(LAVA)) {
+        pos += vec4(u_Sun, 0.);
+    }
+    fs_Pos = pos;
+    fs_Col = vs_Col;                         // Pass the vertex colors to the fragment shader for interpolation
+    fs_UV  = vs_UV;
+
+    mat3 invTranspose = mat3(u_ModelInvTr);
+    fs_Nor = vec4(invTranspose * vec3(vs_Nor), 0);          // Pass the vertex normals to the fragment shader for interpolation.
+                                                            // Transform the geometry's normals by the inverse transpose of the
+                                                            // model matrix. This is necessary to ensure the normals remain
+                                                            // perpendicular to the surface after the surface is transformed by
+                                                            // the model matrix.
+
+    vec4 modelposition = u_Model * pos;   // Temporarily store the transformed vertex positions for use below
+
+    gl_Position = u_ViewProj * modelposition;// gl_Position is a built-in variable of OpenGL which is
+                                             // used to render the final positions of the geometry's vertices
+}
@@ -28,6 +28,10 @@ RESOURCES += glsl.qrc
     QMAKE_CXXFLAGS += -Wall -Wextra -pedantic -Winit-self
     QMAKE_CXXFLAGS += -Wno-strict-aliasing
     QMAKE_CXXFLAGS += -fno-omit-frame-pointer
+    # Keep a * b + c as two roundings even when FMA is available (e.g. with
+    # -march=native), so terrain noise is the same on every build and
+    # SIMD width (see src/simd.h)
+    QMAKE_CXXFLAGS += -ffp-contract=off
 }
 linux-clang*|linux-g++*|macx-clang*|macx-g++* {
     message("Enabling stack protector")
@@ -4,7 +4,7 @@
 Drawable::Drawable(OpenGLContext* context)
     : m_count(-1), m_count_trans(-1), m_bufIdx(), m_bufPos(), m_bufNor(), m_bufCol(), m_bufInter(), m_bufIdxTrans(), m_bufInterTrans(),
       m_idxGenerated(false), m_posGenerated(false), m_norGenerated(false), m_colGenerated(false), m_interGenerated(false),
-      m_idxTransGenerated(false), m_interTransGenerated(false),
+      m_idxTransGenerated(false), m_interTransGenerated(false), m_quadIndices(false),
       mp_context(context)
 {}
 
@@ -14,14 +14,17 @@ Drawable::~Drawable()
 
 void Drawable::destroyVBOdata()
 {
-    mp_context->glDeleteBuffers(1, &m_bufIdx);
-    mp_context->glDeleteBuffers(1, &m_bufIdxTrans);
-    mp_context->glDeleteBuffers(1, &m_bufPos);
-    mp_context->glDeleteBuffers(1, &m_bufNor);
-    mp_context->glDeleteBuffers(1, &m_bufCol);
-    mp_context->glDeleteBuffers(1, &m_bufInter);
-    mp_context->glDeleteBuffers(1, &m_bufInterTrans);
-    m_idxGenerated = m_posGenerated = m_norGenerated = m_colGenerated = m_interGenerated = m_interTransGenerated = m_bufInterTrans = false;
+    // Without a context (e.g. in the headless benchmark) no buffers exist
+    if (mp_context != nullptr) {
+        mp_context->glDeleteBuffers(1, &m_bufIdx);
+        mp_context->glDeleteBuffers(1, &m_bufIdxTrans);
+        mp_context->glDeleteBuffers(1, &m_bufPos);
+        mp_context->glDeleteBuffers(1, &m_bufNor);
+        mp_context->glDeleteBuffers(1, &m_bufCol);
+        mp_context->glDeleteBuffers(1, &m_bufInter);
+        mp_context->glDeleteBuffers(1, &m_bufInterTrans);
+    }
+    m_idxGenerated = m_posGenerated = m_norGenerated = m_colGenerated = m_interGenerated = m_interTransGenerated = m_idxTransGenerated = false;
     m_count = -1;
     m_count_trans = -1;
 }
@@ -91,8 +94,17 @@ void Drawable::generateInterTrans()
     mp_context->glGenBuffers(1, &m_bufInterTrans);
 }
 
+void Drawable::useQuadIndices()
+{
+    m_quadIndices = true;
+}
+
 bool Drawable::bindIdx()
 {
+    if (m_quadIndices) {
+        mp_context->bindQuadIndexBuffer(m_count / 6);
+        return true;
+    }
     if(m_idxGenerated) {
         mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
     }
@@ -101,6 +113,10 @@ bool Drawable::bindIdx()
 
 bool Drawable::bindIdxTrans()
 {
+    if (m_quadIndices) {
+        mp_context->bindQuadIndexBuffer(m_count_trans / 6);
+        return true;
+    }
     if(m_idxTransGenerated) {
         mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxTrans);
     }
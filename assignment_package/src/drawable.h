@@ -25,6 +25,8 @@ protected:
     bool m_colGenerated;
     bool m_interGenerated;
     bool m_interTransGenerated;
+    // Set by useQuadIndices()
+    bool m_quadIndices;
 
     OpenGLContext* mp_context; // Since Qt's OpenGL support is done through classes like QOpenGLFunctions_3_2_Core,
                           // we need to pass our OpenGL context to the Drawable in order to call GL functions
@@ -51,6 +53,11 @@ public:
     void generateCol();
     void generateInter();
     void generateInterTrans();
+    // For geometry made only of quads, each four consecutive vertices:
+    // makes bindIdx() and bindIdxTrans() bind the context's shared quad
+    // index buffer (see OpenGLContext::bindQuadIndexBuffer), so the
+    // Drawable needs no index buffers of its own
+    void useQuadIndices();
 
     bool bindIdx();
     bool bindIdxTrans();
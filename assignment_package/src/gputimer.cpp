@@ -0,0 +1,65 @@
+#include "gputimer.h"
+
+GpuTimer::GpuTimer(OpenGLContext* context)
+    : mp_context(context), m_queries(), m_inFlight(), m_next(0),
+      m_timing(false), m_created(false), m_lastMs(-1.f)
+{}
+
+void GpuTimer::create() {
+    mp_context->glGenQueries(GPU_TIMER_QUERIES, m_queries.data());
+    m_inFlight.fill(false);
+    m_created = true;
+}
+
+void GpuTimer::destroy() {
+    if (m_created) {
+        mp_context->glDeleteQueries(GPU_TIMER_QUERIES, m_queries.data());
+        m_created = false;
+    }
+}
+
+void GpuTimer::collect() {
+    for (int i = 0; i < GPU_TIMER_QUERIES; i++) {
+        int q = (m_next + i) % GPU_TIMER_QUERIES;
+        if (!m_inFlight[q]) {
+            continue;
+        }
+        GLuint available = 0;
+        mp_context->glGetQueryObjectuiv(m_queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            // Queries finish in order, so the later ones aren't done either
+            return;
+        }
+        // 32 bits of nanoseconds, enough for frames of up to 4 seconds
+        GLuint ns = 0;
+        mp_context->glGetQueryObjectuiv(m_queries[q], GL_QUERY_RESULT, &ns);
+        m_lastMs = ns * 1e-6f;
+        m_inFlight[q] = false;
+    }
+}
+
+void GpuTimer::begin() {
+    if (!m_created) {
+        return;
+    }
+    collect();
+    if (m_inFlight[m_next]) {
+        return;
+    }
+    mp_context->glBeginQuery(GL_TIME_ELAPSED, m_queries[m_next]);
+    m_timing = true;
+}
+
+void GpuTimer::end() {
+    if (!m_timing) {
+        return;
+    }
+    mp_context->glEndQuery(GL_TIME_ELAPSED);
+    m_inFlight[m_next] = true;
+    m_next = (m_next + 1) % GPU_TIMER_QUERIES;
+    m_timing = false;
+}
+
+float GpuTimer::lastMs() const {
+    return m_lastMs;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <openglcontext.h>
+#include <array>
+
+// Queries in flight at once. Results arrive a frame or two late, so the
+// timer never has to wait on the GPU for the newest one.
+#define GPU_TIMER_QUERIES 4
+
+// Measures how long the GPU takes to run the commands issued between
+// begin() and end(), using GL_TIME_ELAPSED queries.
+class GpuTimer
+{
+public:
+    GpuTimer(OpenGLContext* context);
+
+    // Call once the context is current, e.g. from initializeGL()
+    void create();
+    void destroy();
+
+    // Brackets one frame's commands. If every query is still waiting on
+    // the GPU, this frame isn't timed.
+    void begin();
+    void end();
+
+    // Milliseconds of the most recent timed frame whose result came back,
+    // or -1 if none has yet
+    float lastMs() const;
+
+private:
+    OpenGLContext* mp_context;
+    std::array<GLuint, GPU_TIMER_QUERIES> m_queries;
+    std::array<bool, GPU_TIMER_QUERIES> m_inFlight;
+    int m_next;       // The oldest query, reused by the next begin()
+    bool m_timing;    // Is a query open between begin() and end()?
+    bool m_created;
+    float m_lastMs;
+
+    // Reads every finished query, oldest first
+    void collect();
+};
@@ -0,0 +1,117 @@
+#include "jobsystem.h"
+#include "profiler.h"
+#include <algorithm>
+#include <string>
+
+// The pool this thread is a worker of, or nullptr off every pool, and its
+// index there. A job may submit to a different pool than the one running
+// it, where the index means nothing.
+static thread_local const JobSystem *currentPool = nullptr;
+static thread_local unsigned int currentWorker = 0;
+
+JobSystem::JobSystem(unsigned int numWorkers)
+    : m_workers(), m_threads(), m_sleepMutex(), m_wake(), m_stopping(false),
+      m_pending(0), m_nextWorker(0)
+{
+    // hardware_concurrency() may report 0 when it cannot tell
+    numWorkers = std::max(numWorkers, 1u);
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        m_workers.push_back(mkU<Worker>());
+    }
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        m_threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+}
+
+JobSystem::~JobSystem() {
+    shutdown();
+}
+
+std::future<void> JobSystem::submit(Job job) {
+    std::packaged_task<void()> task(std::move(job));
+    std::future<void> result = task.get_future();
+
+    unsigned int index = currentPool == this ? currentWorker : m_nextWorker++ % m_workers.size();
+    {
+        // Taking the sleep mutex means a worker cannot miss this wake-up
+        // between checking m_pending and going to sleep. Counting the job
+        // before it is queued keeps m_pending from dipping below zero when
+        // a worker grabs it straight away.
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_pending++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->jobs.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+    return result;
+}
+
+void JobSystem::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        if (m_stopping) return;
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &t : m_threads) {
+        t.join();
+    }
+    m_threads.clear();
+    for (auto &w : m_workers) {
+        w->jobs.clear();
+    }
+    m_pending = 0;
+}
+
+unsigned int JobSystem::workerCount() const {
+    return m_workers.size();
+}
+
+size_t JobSystem::pendingCount() const {
+    return m_pending;
+}
+
+bool JobSystem::takeJob(unsigned int index, std::packaged_task<void()> &job) {
+    {
+        Worker &own = *m_workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+    for (unsigned int i = 1; i < m_workers.size(); i++) {
+        Worker &victim = *m_workers[(index + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::workerLoop(unsigned int index) {
+    currentPool = this;
+    currentWorker = index;
+    Profiler::instance().setThreadName("Worker " + std::to_string(index));
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wake.wait(lock, [this]() { return m_stopping || m_pending > 0; });
+            if (m_stopping) return;
+        }
+        std::packaged_task<void()> job;
+        if (takeJob(index, job)) {
+            m_pending--;
+            job();
+        } else {
+            // Another worker got there first, or the job is still being queued
+            std::this_thread::yield();
+        }
+    }
+}
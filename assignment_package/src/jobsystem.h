@@ -0,0 +1,58 @@
+#pragma once
+#include "smartpointerhelp.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed-size pool of worker threads that runs submitted jobs.
+// Every worker owns a deque of jobs. It takes work from the back of its
+// own deque, and once that runs dry it steals from the front of the other
+// workers' deques, so the pool stays busy without one shared queue that
+// every thread has to fight over.
+class JobSystem {
+public:
+    using Job = std::function<void()>;
+
+    // Defaults to one worker per hardware thread
+    explicit JobSystem(unsigned int numWorkers = std::thread::hardware_concurrency());
+    ~JobSystem();
+
+    // Queues the job and returns a future that becomes ready once it has run.
+    // Jobs submitted from one of this pool's workers go to that worker's
+    // own deque.
+    std::future<void> submit(Job job);
+    // Stops the workers once their current jobs finish and joins them.
+    // Jobs that have not started yet are discarded, and their futures
+    // report std::future_errc::broken_promise.
+    void shutdown();
+
+    unsigned int workerCount() const;
+    // Number of jobs queued but not yet started
+    size_t pendingCount() const;
+
+private:
+    struct Worker {
+        std::deque<std::packaged_task<void()>> jobs;
+        std::mutex mutex;
+    };
+
+    std::vector<uPtr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+
+    // Idle workers sleep on m_wake until a job is queued or the pool stops
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stopping;
+
+    std::atomic<size_t> m_pending;
+    std::atomic<unsigned int> m_nextWorker; // Round-robin target for outside submissions
+
+    void workerLoop(unsigned int index);
+    // Pops from the worker's own deque, or steals from another one
+    bool takeJob(unsigned int index, std::packaged_task<void()> &job);
+};
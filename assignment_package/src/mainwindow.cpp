@@ -18,6 +18,12 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->mygl, SIGNAL(sig_sendPlayerLook(QString)), &playerInfoWindow, SLOT(slot_setLookText(QString)));
     connect(ui->mygl, SIGNAL(sig_sendPlayerChunk(QString)), &playerInfoWindow, SLOT(slot_setChunkText(QString)));
     connect(ui->mygl, SIGNAL(sig_sendPlayerTerrainZone(QString)), &playerInfoWindow, SLOT(slot_setZoneText(QString)));
+    connect(ui->mygl, SIGNAL(sig_sendTerrainLoad(QString)), &playerInfoWindow, SLOT(slot_setTerrainLoadText(QString)));
+    connect(ui->mygl, SIGNAL(sig_sendTerrainUpload(QString)), &playerInfoWindow, SLOT(slot_setTerrainUploadText(QString)));
+    connect(ui->mygl, SIGNAL(sig_sendFrameTime(QString)), &playerInfoWindow, SLOT(slot_setFrameTimeText(QString)));
+    connect(ui->mygl, SIGNAL(sig_sendChunkCounts(QString)), &playerInfoWindow, SLOT(slot_setChunkCountsText(QString)));
+    connect(ui->mygl, SIGNAL(sig_sendJobQueues(QString)), &playerInfoWindow, SLOT(slot_setJobQueuesText(QString)));
+    connect(ui->mygl, SIGNAL(sig_sendProfile(QString)), &playerInfoWindow, SLOT(slot_setProfileText(QString)));
 }
 
 MainWindow::~MainWindow()
@@ -1,10 +1,15 @@
 #include "mygl.h"
+#include "profiler.h"
 #include <glm_includes.h>
 
 #include <iostream>
 #include <QApplication>
 #include <QKeyEvent>
 #include <QDir>
+#include <algorithm>
+#include <iomanip>
+#include <random>
+#include <sstream>
 
 glm::vec3 sun = glm::vec3(0., 0., 0.);
 const int sun_radius = 128;
@@ -12,10 +17,10 @@ const int sun_radius = 128;
 MyGL::MyGL(QWidget *parent)
     : OpenGLContext(parent),
       m_worldAxes(this),
-      m_progLambert(this), m_progFlat(this), m_progInstanced(this), m_progSky(this),
+      m_progLambert(this), m_progFlat(this), m_progInstanced(this), m_progSky(this), m_progPlanet(this),
       m_terrain(this), m_player(glm::vec3(48.f, 129.f, 48.f), m_terrain),
       m_planet(this, sun, sun_radius), m_quad(this),
-      m_textureAlbedo(this), m_textureNormals(this),
+      m_textureAlbedo(this), m_textureNormals(this), m_gpuTimer(this),
       m_time(QDateTime::currentMSecsSinceEpoch()), last_time(QDateTime::currentMSecsSinceEpoch())
 {
     // Connect the timer to a function so that when the timer ticks the function is executed
@@ -31,6 +36,8 @@ MyGL::MyGL(QWidget *parent)
 MyGL::~MyGL() {
     makeCurrent();
     glDeleteVertexArrays(1, &vao);
+    m_gpuTimer.destroy();
+    destroyQuadIndexBuffer();
 }
 
 QString MyGL::getCurrentPath() const {
@@ -72,6 +79,8 @@ void MyGL::initializeGL()
 
     // Create a Vertex Attribute Object
     glGenVertexArrays(1, &vao);
+    m_gpuTimer.create();
+    Profiler::instance().setThreadName("GUI");
 
     //Create the instance of the world axes
     m_worldAxes.createVBOdata();
@@ -82,6 +91,7 @@ void MyGL::initializeGL()
     m_progFlat.create(":/glsl/flat.vert.glsl", ":/glsl/flat.frag.glsl");
 //    m_progInstanced.create(":/glsl/instanced.vert.glsl", ":/glsl/lambert.frag.glsl");
     m_progSky.create(":/glsl/sky.vert.glsl", ":/glsl/sky.frag.glsl");
+    m_progPlanet.create(":/glsl/planet.vert.glsl", ":/glsl/lambert.frag.glsl");
     m_quad.createVBOdata();
     // Set a color with which to draw geometry.
     // This will ultimately not be used when you change
@@ -103,6 +113,16 @@ void MyGL::initializeGL()
     m_textureNormals.create(path2.toStdString().c_str());
     m_textureNormals.load(1);
 
+    // A new world gets a random seed; an existing one keeps its own
+    m_terrain.setNoiseSettings(NoiseSettings{NOISE_INTEGER_HASH, std::random_device()()});
+    QString savePath = getCurrentPath();
+    savePath.append("/saves/world");
+    m_terrain.setSaveDirectory(savePath.toStdString());
+    const NoiseSettings &noise = m_terrain.getNoiseSettings();
+    // Both programs shade with lambert.frag.glsl, so both hash its noise
+    m_progLambert.setNoise(noise.backend, noise.seed);
+    m_progPlanet.setNoise(noise.backend, noise.seed);
+
 //    m_terrain.CreateTestScene();
 //    m_terrain.CreateNewScene();
     m_planet.createPlanet();
@@ -117,6 +137,7 @@ void MyGL::resizeGL(int w, int h) {
     // Upload the view-projection matrix to our shaders (i.e. onto the graphics card)
 
     m_progLambert.setViewProjMatrix(viewproj);
+    m_progPlanet.setViewProjMatrix(viewproj);
     m_progFlat.setViewProjMatrix(viewproj);
     m_progSky.setViewProjMatrix(glm::inverse(viewproj));
 
@@ -134,19 +155,24 @@ void MyGL::resizeGL(int w, int h) {
 // all per-frame actions here, such as performing physics updates on all
 // entities in the scene.
 void MyGL::tick() {
-    m_terrain.checkTerrain(m_player.mcr_position);
-
-
     int64_t currMSec = QDateTime::currentMSecsSinceEpoch();
     int64_t deltaTime = currMSec - last_time;
     last_time = currMSec;
+    // The frame that ends here includes the last paintGL()
+    sendProfileDataToGUI(deltaTime);
+    PROFILE_SCOPE("MyGL::tick");
+
+    m_terrain.checkTerrain(m_player.mcr_position, m_player.mcr_camera.getForward());
+
     int time_passed = currMSec - m_time;
     m_progLambert.setTime(time_passed);
+    m_progPlanet.setTime(time_passed);
 
     // update the center of the sun
     time++;
     m_planet.move(time);
     m_progLambert.setSun(m_planet.center);
+    m_progPlanet.setSun(m_planet.center);
     m_progSky.setSun(m_planet.center);
     m_player.tick(deltaTime, m_inputs);
     m_progSky.setPlayer(m_player.mcr_position);
@@ -164,18 +190,112 @@ void MyGL::sendPlayerDataToGUI() const {
     glm::ivec2 zone(64 * glm::ivec2(glm::floor(pPos / 64.f)));
     emit sig_sendPlayerChunk(QString::fromStdString("( " + std::to_string(chunk.x) + ", " + std::to_string(chunk.y) + " )"));
     emit sig_sendPlayerTerrainZone(QString::fromStdString("( " + std::to_string(zone.x) + ", " + std::to_string(zone.y) + " )"));
+    const ChunkScheduler &sched = m_terrain.getScheduler();
+    std::string visible = sched.isWaitingForTerrain() ? "waiting"
+                        : std::to_string(static_cast<int>(sched.lastTimeToVisible())) + " ms";
+    emit sig_sendTerrainLoad(QString::fromStdString(visible + " ( " + std::to_string(sched.pendingCount()) + " queued, "
+                                                    + std::to_string(sched.inFlightCount()) + " running )"));
+    const ChunkUploadQueue &uploads = m_terrain.getUploadQueue();
+    emit sig_sendTerrainUpload(QString::fromStdString(std::to_string(uploads.chunksLastFrame()) + " chunks, "
+                                                      + std::to_string(uploads.bytesLastFrame() / 1024) + " KB ( "
+                                                      + std::to_string(uploads.depth()) + " waiting )"));
+}
+
+void MyGL::sendProfileDataToGUI(int64_t deltaTime) {
+    Profiler &profiler = Profiler::instance();
+    const ChunkScheduler &sched = m_terrain.getScheduler();
+    const ChunkUploadQueue &uploads = m_terrain.getUploadQueue();
+    size_t jobsQueued = m_terrain.getJobSystem().pendingCount();
+    size_t chunks = m_terrain.chunkCount(), uploaded = m_terrain.uploadedChunkCount();
+    profiler.counter("Frame interval (ms)", deltaTime);
+    profiler.counter("GPU frame (ms)", m_gpuTimer.lastMs());
+    profiler.counter("Jobs queued", jobsQueued);
+    profiler.counter("Chunk tasks pending", sched.pendingCount());
+    profiler.counter("Chunk tasks running", sched.inFlightCount());
+    profiler.counter("Meshes waiting for upload", uploads.depth());
+    profiler.counter("Chunks loaded", chunks);
+    profiler.counter("Chunks on GPU", uploaded);
+    profiler.counter("Chunks drawn", m_terrain.drawnChunkCount());
+    profiler.counter("Chunks culled", m_terrain.culledChunkCount());
+    profiler.counter("Chunks occluded", m_terrain.occludedChunkCount());
+    profiler.counter("Triangles occluded", m_terrain.occludedTriangleCount());
+    profiler.counter("Terrain draw calls", m_terrain.drawCallCount());
+    profiler.counter("Chunk arena used (MB)", m_terrain.getArena().usedBytes() / double(1 << 20));
+    profiler.endFrame();
+
+    std::ostringstream frame;
+    frame << std::fixed << std::setprecision(1) << deltaTime << " ms apart, CPU "
+          << profiler.lastFrameMs("MyGL::tick") + profiler.lastFrameMs("MyGL::paintGL") << " ms, GPU ";
+    if (m_gpuTimer.lastMs() < 0.f) {
+        frame << "UNK";
+    } else {
+        frame << m_gpuTimer.lastMs() << " ms";
+    }
+    emit sig_sendFrameTime(QString::fromStdString(frame.str()));
+
+    auto meshed = profiler.lastFrame().find("Chunk::buildVBOdata");
+    unsigned int meshedCount = meshed == profiler.lastFrame().end() ? 0 : meshed->second.count;
+    emit sig_sendChunkCounts(QString::fromStdString(std::to_string(chunks) + " loaded, " + std::to_string(uploaded)
+                                                    + " on GPU, " + std::to_string(meshedCount) + " meshed, "
+                                                    + std::to_string(m_terrain.drawnChunkCount()) + " drawn, "
+                                                    + std::to_string(m_terrain.culledChunkCount()) + " culled, "
+                                                    + std::to_string(m_terrain.occludedChunkCount()) + " occluded ( "
+                                                    + std::to_string(m_terrain.occludedTriangleCount() / 1000) + "k tris ), "
+                                                    + std::to_string(m_terrain.drawCallCount()) + " draw calls"));
+    emit sig_sendJobQueues(QString::fromStdString(std::to_string(jobsQueued) + " pool, "
+                                                  + std::to_string(sched.pendingCount()) + " scheduled, "
+                                                  + std::to_string(sched.inFlightCount()) + " running"));
+
+    // Every label timed in the frame, slowest first. Worker time is summed
+    // over the workers, so it can add up to more than the frame.
+    std::vector<std::pair<double, std::string>> slowest;
+    for (auto &[label, stat] : profiler.lastFrame()) {
+        std::ostringstream line;
+        line << label << ": " << std::fixed << std::setprecision(2) << stat.ms << " ms";
+        if (stat.count > 1) {
+            line << " ( " << stat.count << "x )";
+        }
+        slowest.emplace_back(stat.ms, line.str());
+    }
+    std::sort(slowest.begin(), slowest.end(), std::greater<>());
+    std::string text;
+    for (auto &[ms, line] : slowest) {
+        text += line + "\n";
+    }
+    if (profiler.isTracing()) {
+        text += "Recording trace, P to stop";
+    }
+    emit sig_sendProfile(QString::fromStdString(text));
+}
+
+void MyGL::toggleTrace() {
+    Profiler &profiler = Profiler::instance();
+    if (!profiler.isTracing()) {
+        profiler.startTrace();
+        return;
+    }
+    QString path = getCurrentPath();
+    path.append("/trace-" + QString::number(QDateTime::currentMSecsSinceEpoch()) + ".json");
+    if (profiler.stopTrace(path.toStdString())) {
+        std::cout << "Wrote trace to " << path.toStdString() << std::endl;
+    } else {
+        std::cout << "Could not write trace to " << path.toStdString() << std::endl;
+    }
 }
 
 // This function is called whenever update() is called.
 // MyGL's constructor links update() to a timer that fires 60 times per second,
 // so paintGL() called at a rate of 60 frames per second.
 void MyGL::paintGL() {
+    PROFILE_SCOPE("MyGL::paintGL");
+    m_gpuTimer.begin();
     // Clear the screen so that we only see newly drawn images
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glm::mat4 viewproj = m_player.mcr_camera.getViewProj();
     m_progFlat.setViewProjMatrix(viewproj);
     m_progLambert.setViewProjMatrix(viewproj);
+    m_progPlanet.setViewProjMatrix(viewproj);
     m_progInstanced.setViewProjMatrix(viewproj);
     m_progSky.setViewProjMatrix(glm::inverse(viewproj));
 
@@ -198,14 +318,15 @@ void MyGL::paintGL() {
     m_progLambert.setModelMatrix(glm::mat4());
     m_progLambert.setViewProjMatrix(m_player.mcr_camera.getViewProj());
     glEnable(GL_DEPTH_TEST);
+    m_gpuTimer.end();
 }
 
 // TODO: Change this so it renders the nine zones of generated
 // terrain that surround the player (refer to Terrain::m_generatedTerrain
 // for more info)
 void MyGL::renderTerrain() {
-    m_terrain.draw(&m_progLambert, m_player.mcr_position);
-    m_planet.draw(&m_progLambert);
+    m_terrain.draw(&m_progLambert, m_player.mcr_camera.mcr_position, m_player.mcr_camera.getViewProj());
+    m_planet.draw(&m_progPlanet);
 }
 
 
@@ -231,6 +352,13 @@ void MyGL::keyPressEvent(QKeyEvent *e) {
         m_inputs.qPressed = true;
     } else if (e->key() == Qt::Key_F) {
         m_inputs.flightMode = !m_inputs.flightMode;
+    } else if (e->key() == Qt::Key_G) {
+        Chunk::greedyMeshing = !Chunk::greedyMeshing;
+        m_terrain.remeshAll();
+    } else if (e->key() == Qt::Key_P) {
+        toggleTrace();
+    } else if (e->key() == Qt::Key_O) {
+        m_terrain.setOcclusionCulling(!m_terrain.occlusionCulling());
     } else if (e->key() == Qt::Key_Space) {
         m_inputs.spacePressed = true;
     } else if (e->key() == Qt::Key_Shift) {
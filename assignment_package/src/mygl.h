@@ -11,6 +11,7 @@
 #include "scene/planet.h"
 #include "scene/quad.h"
 #include "texture.h"
+#include "gputimer.h"
 
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
@@ -26,6 +27,7 @@ private:
     ShaderProgram m_progFlat;// A shader program that uses "flat" reflection (no shadowing at all)
     ShaderProgram m_progInstanced;// A shader program that is designed to be compatible with instanced rendering
     ShaderProgram m_progSky; // A shader program used to draw the background sky
+    ShaderProgram m_progPlanet; // Lambert shading for the Planet's unpacked vertex layout
     Quad m_quad; // Used to draw sky
     GLuint vao; // A handle for our vertex array object. This will store the VBOs created in our geometry classes.
                 // Don't worry too much about this. Just know it is necessary in order to render geometry.
@@ -40,6 +42,8 @@ private:
     Texture m_textureAlbedo;
     Texture m_textureNormals;
 
+    GpuTimer m_gpuTimer; // Times the commands paintGL() issues on the GPU
+
     int64_t m_time;
     int64_t last_time;
     float time;
@@ -51,6 +55,12 @@ private:
                               // your mouse stays within the screen bounds and is always read.
 
     void sendPlayerDataToGUI() const;
+    // Closes the Profiler's frame, adding the queue depths and GPU time,
+    // and sends its totals to the secondary window
+    void sendProfileDataToGUI(int64_t deltaTime);
+    // Starts a Chrome trace, or stops the current one and writes it
+    // next to the saves
+    void toggleTrace();
 
 
 public:
@@ -97,6 +107,12 @@ signals:
     void sig_sendPlayerLook(QString) const;
     void sig_sendPlayerChunk(QString) const;
     void sig_sendPlayerTerrainZone(QString) const;
+    void sig_sendTerrainLoad(QString) const;
+    void sig_sendTerrainUpload(QString) const;
+    void sig_sendFrameTime(QString) const;
+    void sig_sendChunkCounts(QString) const;
+    void sig_sendJobQueues(QString) const;
+    void sig_sendProfile(QString) const;
 };
 
 
@@ -5,10 +5,14 @@
 #include <QProcessEnvironment>
 #include <QOpenGLContext>
 #include <QDebug>
+#include <algorithm>
+#include <vector>
 
 
 OpenGLContext::OpenGLContext(QWidget *parent)
-    : QOpenGLWidget(parent)
+    : QOpenGLWidget(parent),
+      m_multiDrawElementsBaseVertex(nullptr), m_multiDrawResolved(false),
+      m_quadIndexBuffer(0), m_quadIndexCapacity(0)
 {}
 
 OpenGLContext::~OpenGLContext()
@@ -69,6 +73,51 @@ void OpenGLContext::debugContextVersion()
     }
 }
 
+void OpenGLContext::glMultiDrawElementsBaseVertex(GLenum mode, const GLsizei *count, GLenum type,
+                                                  const void *const *indices, GLsizei drawcount,
+                                                  const GLint *basevertex)
+{
+    if (!m_multiDrawResolved) {
+        m_multiDrawResolved = true;
+        m_multiDrawElementsBaseVertex = reinterpret_cast<MultiDrawElementsBaseVertexProc>(
+            context()->getProcAddress("glMultiDrawElementsBaseVertex"));
+    }
+    if (m_multiDrawElementsBaseVertex != nullptr) {
+        m_multiDrawElementsBaseVertex(mode, count, type, indices, drawcount, basevertex);
+        return;
+    }
+    for (GLsizei i = 0; i < drawcount; i++) {
+        glDrawElementsBaseVertex(mode, count[i], type, const_cast<void*>(indices[i]), basevertex[i]);
+    }
+}
+
+void OpenGLContext::bindQuadIndexBuffer(size_t quads)
+{
+    if (m_quadIndexCapacity == 0) {
+        glGenBuffers(1, &m_quadIndexBuffer);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_quadIndexBuffer);
+    if (quads <= m_quadIndexCapacity) {
+        return;
+    }
+    // Doubling keeps the number of regrowths logarithmic in the largest mesh
+    m_quadIndexCapacity = std::max({quads, 2 * m_quadIndexCapacity, size_t(1 << 14)});
+    std::vector<GLuint> indices;
+    indices.reserve(6 * m_quadIndexCapacity);
+    for (GLuint v = 0; v < 4 * m_quadIndexCapacity; v += 4) {
+        indices.insert(indices.end(), {v, v + 1, v + 2, v, v + 2, v + 3});
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+}
+
+void OpenGLContext::destroyQuadIndexBuffer()
+{
+    if (m_quadIndexCapacity > 0) {
+        glDeleteBuffers(1, &m_quadIndexBuffer);
+        m_quadIndexCapacity = 0;
+    }
+}
+
 void OpenGLContext::printGLErrorLog()
 {
     GLenum error = glGetError();
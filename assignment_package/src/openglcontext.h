@@ -18,4 +18,29 @@ public:
     void printGLErrorLog();
     void printLinkInfoLog(int prog);
     void printShaderInfoLog(int shader);
+
+    // Binds the index buffer shared by everything drawn as quads, whose
+    // indices 6q to 6q + 5 are the triangles (4q, 4q + 1, 4q + 2) and
+    // (4q, 4q + 2, 4q + 3) of quad q. Grows it first if it holds fewer
+    // than quads quads.
+    void bindQuadIndexBuffer(size_t quads);
+    // Frees the shared quad index buffer; call with the context current
+    void destroyQuadIndexBuffer();
+
+    // Not part of QOpenGLExtraFunctions, so it is looked up in the context
+    // the first time it is called. Where the driver doesn't have it, each
+    // draw goes through glDrawElementsBaseVertex instead.
+    void glMultiDrawElementsBaseVertex(GLenum mode, const GLsizei *count, GLenum type,
+                                       const void *const *indices, GLsizei drawcount,
+                                       const GLint *basevertex);
+
+private:
+    using MultiDrawElementsBaseVertexProc = void (QOPENGLF_APIENTRYP)(GLenum, const GLsizei*, GLenum,
+                                                                      const void *const*, GLsizei,
+                                                                      const GLint*);
+    MultiDrawElementsBaseVertexProc m_multiDrawElementsBaseVertex;
+    bool m_multiDrawResolved;
+
+    GLuint m_quadIndexBuffer;
+    size_t m_quadIndexCapacity; // In quads; 0 until the buffer is created
 };
@@ -36,3 +36,26 @@ void PlayerInfo::slot_setZoneText(QString s) {
     ui->zoneLabel->setText(s);
 }
 
+void PlayerInfo::slot_setTerrainLoadText(QString s) {
+    ui->terrainLoadLabel->setText(s);
+}
+
+void PlayerInfo::slot_setTerrainUploadText(QString s) {
+    ui->terrainUploadLabel->setText(s);
+}
+
+void PlayerInfo::slot_setFrameTimeText(QString s) {
+    ui->frameTimeLabel->setText(s);
+}
+
+void PlayerInfo::slot_setChunkCountsText(QString s) {
+    ui->chunkCountsLabel->setText(s);
+}
+
+void PlayerInfo::slot_setJobQueuesText(QString s) {
+    ui->jobQueuesLabel->setText(s);
+}
+
+void PlayerInfo::slot_setProfileText(QString s) {
+    ui->profileLabel->setText(s);
+}
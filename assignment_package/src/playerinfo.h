@@ -20,6 +20,12 @@ public slots:
     void slot_setLookText(QString);
     void slot_setChunkText(QString);
     void slot_setZoneText(QString);
+    void slot_setTerrainLoadText(QString);
+    void slot_setTerrainUploadText(QString);
+    void slot_setFrameTimeText(QString);
+    void slot_setChunkCountsText(QString);
+    void slot_setJobQueuesText(QString);
+    void slot_setProfileText(QString);
 
 private:
     Ui::PlayerInfo *ui;
@@ -0,0 +1,169 @@
+#include "profiler.h"
+#include <fstream>
+
+// The ring of the thread running this, once it has recorded anything
+static thread_local void *currentRing = nullptr;
+
+Profiler::Ring::Ring(unsigned int id)
+    : entries(), written(0), read(0), threadId(id), threadName()
+{}
+
+Profiler::Profiler()
+    : m_epoch(std::chrono::steady_clock::now()), m_ringsMutex(), m_rings(),
+      m_lastFrame(), m_counters(), m_lastCounters(), m_dropped(0),
+      m_tracing(false), m_traceEvents(), m_traceCounters()
+{}
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+Profiler::Ring& Profiler::threadRing() {
+    if (currentRing == nullptr) {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.push_back(mkU<Ring>(static_cast<unsigned int>(m_rings.size())));
+        currentRing = m_rings.back().get();
+    }
+    return *static_cast<Ring*>(currentRing);
+}
+
+void Profiler::record(const char *label, uint64_t start, uint64_t end) {
+    Ring &ring = threadRing();
+    uint64_t w = ring.written.load(std::memory_order_relaxed);
+    // Once endFrame() sees any of the stores below it also sees written
+    // at w or later, so it can tell the slot's old event was overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+    Ring::Slot &slot = ring.entries[w % PROFILER_RING_SIZE];
+    slot.label.store(label, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    ring.written.store(w + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const std::string &name) {
+    Ring &ring = threadRing();
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    ring.threadName = name;
+}
+
+void Profiler::counter(const char *label, double value) {
+    m_counters[label] = value;
+    if (m_tracing && m_traceCounters.size() < PROFILER_TRACE_MAX_EVENTS) {
+        m_traceCounters.push_back(TraceCounter{label, now(), value});
+    }
+}
+
+void Profiler::endFrame() {
+    std::vector<Ring*> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        for (auto &r : m_rings) {
+            rings.push_back(r.get());
+        }
+    }
+
+    std::map<std::string, Stat> frame;
+    std::vector<TraceEvent> events;
+    for (Ring *ring : rings) {
+        uint64_t w = ring->written.load(std::memory_order_acquire);
+        uint64_t r = ring->read;
+        if (w - r > PROFILER_RING_SIZE) {
+            m_dropped += w - r - PROFILER_RING_SIZE;
+            r = w - PROFILER_RING_SIZE;
+        }
+        events.clear();
+        for (uint64_t i = r; i < w; i++) {
+            const Ring::Slot &slot = ring->entries[i % PROFILER_RING_SIZE];
+            events.push_back(TraceEvent{slot.label.load(std::memory_order_relaxed), ring->threadId,
+                                        slot.start.load(std::memory_order_relaxed),
+                                        slot.end.load(std::memory_order_relaxed)});
+        }
+        // Events the thread started overwriting while we copied them are torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t overwritten = ring->written.load(std::memory_order_relaxed);
+        for (uint64_t i = r; i < w; i++) {
+            if (overwritten - i >= PROFILER_RING_SIZE) {
+                m_dropped++;
+                continue;
+            }
+            const TraceEvent &e = events[i - r];
+            Stat &stat = frame[e.label];
+            stat.ms += (e.end - e.start) * 1e-6;
+            stat.count++;
+            if (m_tracing && m_traceEvents.size() < PROFILER_TRACE_MAX_EVENTS) {
+                m_traceEvents.push_back(e);
+            }
+        }
+        ring->read = w;
+    }
+    m_lastFrame = std::move(frame);
+    m_lastCounters = std::move(m_counters);
+    m_counters.clear();
+}
+
+const std::map<std::string, Profiler::Stat>& Profiler::lastFrame() const {
+    return m_lastFrame;
+}
+
+const std::map<std::string, double>& Profiler::lastCounters() const {
+    return m_lastCounters;
+}
+
+double Profiler::lastFrameMs(const std::string &label) const {
+    auto it = m_lastFrame.find(label);
+    return it == m_lastFrame.end() ? 0.0 : it->second.ms;
+}
+
+size_t Profiler::droppedCount() const {
+    return m_dropped;
+}
+
+void Profiler::startTrace() {
+    m_traceEvents.clear();
+    m_traceCounters.clear();
+    m_tracing = true;
+}
+
+bool Profiler::isTracing() const {
+    return m_tracing;
+}
+
+// Chrome trace event format: "X" is a complete event, "C" a counter and
+// "M" metadata, here the thread names. Times are in microseconds.
+bool Profiler::stopTrace(const std::string &path) {
+    // Whatever the threads recorded since the last frame goes in too
+    endFrame();
+    m_tracing = false;
+
+    std::ofstream out(path);
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"miniMinecraft\"}}";
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        for (auto &ring : m_rings) {
+            std::string name = ring->threadName.empty() ? "Thread " + std::to_string(ring->threadId)
+                                                        : ring->threadName;
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadId
+                << ",\"args\":{\"name\":\"" << name << "\"}}";
+        }
+    }
+    for (const TraceEvent &e : m_traceEvents) {
+        out << ",\n{\"name\":\"" << e.label << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.threadId
+            << ",\"ts\":" << e.start / 1000 << "." << e.start / 100 % 10
+            << ",\"dur\":" << (e.end - e.start) / 1000 << "." << (e.end - e.start) / 100 % 10 << "}";
+    }
+    for (const TraceCounter &c : m_traceCounters) {
+        out << ",\n{\"name\":\"" << c.label << "\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+            << c.time / 1000 << "." << c.time / 100 % 10 << ",\"args\":{\"value\":" << c.value << "}}";
+    }
+    out << "\n]}\n";
+    m_traceEvents.clear();
+    m_traceCounters.clear();
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include "smartpointerhelp.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Events each thread can record between two endFrame() calls before the
+// oldest are lost
+#define PROFILER_RING_SIZE 4096
+// Events a Chrome trace keeps before it stops recording
+#define PROFILER_TRACE_MAX_EVENTS (1 << 20)
+
+// Where each frame's CPU time goes, on every thread.
+// PROFILE_SCOPE("label") times the rest of the enclosing block. Every thread
+// records into a ring of its own without taking any lock; once per frame
+// the GUI thread drains the rings in endFrame() and totals the time spent
+// under each label. Between startTrace() and stopTrace() every event is
+// also kept and written out in the Chrome trace format, which
+// chrome://tracing and Perfetto open.
+// Labels are stored by pointer, so they must be string literals.
+class Profiler {
+public:
+    // The time spent under one label over the last frame, summed over all
+    // threads, and how many scopes with that label ended in it
+    struct Stat {
+        double ms;
+        unsigned int count;
+    };
+
+    static Profiler& instance();
+    // Nanoseconds since the Profiler was created
+    uint64_t now() const;
+
+    // Adds a finished scope to the calling thread's ring. Lock-free once
+    // the thread has recorded its first event.
+    void record(const char *label, uint64_t start, uint64_t end);
+    // Names the calling thread in traces
+    void setThreadName(const std::string &name);
+    // Records a value, e.g. a queue depth, for the current frame and the
+    // trace. GUI thread only.
+    void counter(const char *label, double value);
+
+    // Drains every thread's ring and makes the totals of everything that
+    // ended since the last call, and the counters recorded since then,
+    // available below. GUI thread only.
+    void endFrame();
+    const std::map<std::string, Stat>& lastFrame() const;
+    const std::map<std::string, double>& lastCounters() const;
+    // Milliseconds spent under the label in the last frame, or 0
+    double lastFrameMs(const std::string &label) const;
+    // Events lost because a ring filled up between two endFrame() calls
+    size_t droppedCount() const;
+
+    void startTrace();
+    bool isTracing() const;
+    // Stops recording and writes the trace to path. Returns false if the
+    // file could not be written. GUI thread only.
+    bool stopTrace(const std::string &path);
+
+private:
+    Profiler();
+
+    // Single producer, the thread that owns it, and single consumer, the
+    // GUI thread in endFrame(). The fields are atomics only so a slot the
+    // producer is overwriting can be read without undefined behavior; a
+    // torn read is detected from written and thrown away.
+    struct Ring {
+        struct Slot {
+            std::atomic<const char*> label;
+            std::atomic<uint64_t> start, end;
+        };
+        std::array<Slot, PROFILER_RING_SIZE> entries;
+        std::atomic<uint64_t> written;
+        uint64_t read; // Consumer only
+        unsigned int threadId;
+        std::string threadName; // Guarded by m_ringsMutex
+
+        Ring(unsigned int id);
+    };
+
+    struct TraceEvent {
+        const char *label;
+        unsigned int threadId;
+        uint64_t start, end;
+    };
+    struct TraceCounter {
+        const char *label;
+        uint64_t time;
+        double value;
+    };
+
+    std::chrono::steady_clock::time_point m_epoch;
+
+    // Every ring ever created. Rings outlive their threads, so events a
+    // thread recorded just before exiting are still drained.
+    std::mutex m_ringsMutex;
+    std::vector<uPtr<Ring>> m_rings;
+
+    std::map<std::string, Stat> m_lastFrame;
+    std::map<std::string, double> m_counters;
+    std::map<std::string, double> m_lastCounters;
+    size_t m_dropped;
+
+    std::atomic<bool> m_tracing;
+    std::vector<TraceEvent> m_traceEvents;
+    std::vector<TraceCounter> m_traceCounters;
+
+    // The calling thread's ring, created the first time it records
+    Ring& threadRing();
+};
+
+// Times its own lifetime under label
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char *label)
+        : m_label(label), m_start(Profiler::instance().now())
+    {}
+    ~ScopedTimer() {
+        Profiler &p = Profiler::instance();
+        p.record(m_label, m_start, p.now());
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    const char *m_label;
+    uint64_t m_start;
+};
+
+// Define PROFILER_DISABLED to compile every PROFILE_SCOPE away
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(label)
+#else
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(label) ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(label)
+#endif
@@ -32,6 +32,10 @@ void Camera::tick(float dT, InputBundle &input) {
     // Do nothing
 }
 
+glm::vec3 Camera::getForward() const {
+    return m_forward;
+}
+
 glm::mat4 Camera::getViewProj() const {
     return glm::perspective(glm::radians(m_fovy), m_aspect, m_near_clip, m_far_clip) * glm::lookAt(m_position, m_position + m_forward, m_up);
 }
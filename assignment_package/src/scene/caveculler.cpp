@@ -0,0 +1,93 @@
+#include "caveculler.h"
+#include "terrain.h"
+#include "profiler.h"
+
+static const glm::ivec3 directionSteps[6] = {glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0),
+                                             glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0),
+                                             glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)};
+
+CaveCuller::CaveCuller()
+    : m_minX(0), m_minZ(0), m_size(0), m_everythingVisible(true),
+      m_chunks(), m_visible(), m_queue()
+{}
+
+void CaveCuller::update(const Terrain &terrain, glm::vec3 eye, const Frustum &frustum,
+                        int minX, int minZ, int size) {
+    PROFILE_SCOPE("CaveCuller::update");
+    m_minX = minX;
+    m_minZ = minZ;
+    m_size = size;
+    m_chunks.assign(size * size, nullptr);
+    m_visible.assign(size * size, 0);
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            int x = minX + 16 * i, z = minZ + 16 * j;
+            if (terrain.hasChunkAt(x, z)) {
+                m_chunks[i + size * j] = terrain.getChunkAt(x, z).get();
+            }
+        }
+    }
+
+    glm::ivec3 start(static_cast<int>(glm::floor((eye.x - minX) / 16.f)),
+                     static_cast<int>(glm::floor(eye.y / 16.f)),
+                     static_cast<int>(glm::floor((eye.z - minZ) / 16.f)));
+    m_everythingVisible = start.x < 0 || start.x >= size || start.z < 0 || start.z >= size ||
+                          start.y < 0 || start.y >= CHUNK_SECTIONS;
+    if (m_everythingVisible) {
+        return;
+    }
+
+    m_queue.clear();
+    int startChunk = start.x + size * start.z;
+    m_visible[startChunk] |= 1 << start.y;
+    // The camera sees out of every face of its own section
+    size_t head = 0;
+    bool first = true;
+    m_queue.push_back(Step{startChunk, start.y, XPOS, 0});
+    while (head < m_queue.size()) {
+        Step step = m_queue[head++];
+        const Chunk *c = m_chunks[step.chunk];
+        // Until a Chunk has a mesh, nothing is known to block the view through it
+        SectionConnectivity connectivity = c != nullptr && c->hasGpuMesh()
+                                           ? c->getSectionConnectivity(step.section)
+                                           : SECTION_ALL_CONNECTED;
+        glm::ivec3 pos(step.chunk % size, step.section, step.chunk / size);
+        for (int d = 0; d < 6; d++) {
+            Direction dir = static_cast<Direction>(d);
+            if (step.dirs & (1 << oppositeDirection[dir])) {
+                continue;
+            }
+            if (!first && !facesConnected(connectivity, step.entry, dir)) {
+                continue;
+            }
+            glm::ivec3 next = pos + directionSteps[dir];
+            if (next.x < 0 || next.x >= size || next.z < 0 || next.z >= size ||
+                next.y < 0 || next.y >= CHUNK_SECTIONS) {
+                continue;
+            }
+            int nextChunk = next.x + size * next.z;
+            if (m_visible[nextChunk] & (1 << next.y)) {
+                continue;
+            }
+            glm::vec3 corner(minX + 16 * next.x, 16 * next.y, minZ + 16 * next.z);
+            if (!frustum.intersects(AABB{corner, corner + glm::vec3(16.f)})) {
+                continue;
+            }
+            m_visible[nextChunk] |= 1 << next.y;
+            m_queue.push_back(Step{nextChunk, next.y, oppositeDirection[dir],
+                                   static_cast<uint8_t>(step.dirs | (1 << dir))});
+        }
+        first = false;
+    }
+}
+
+uint16_t CaveCuller::visibleSections(int x, int z) const {
+    if (m_everythingVisible) {
+        return 0xFFFF;
+    }
+    int i = (x - m_minX) / 16, j = (z - m_minZ) / 16;
+    if (x < m_minX || z < m_minZ || i >= m_size || j >= m_size) {
+        return 0xFFFF;
+    }
+    return m_visible[i + m_size * j];
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "glm_includes.h"
+#include "chunk.h"
+#include "frustum.h"
+#include <vector>
+
+class Terrain;
+
+// Occlusion culling for the sections of Chunks that solid terrain hides,
+// e.g. valleys behind a mountain or the ground under the player's feet.
+// A breadth-first search starts at the camera's section. It steps from a
+// section into a neighbor only through a face that the see-through blocks
+// connect to the face it came in by, and never back towards the camera.
+// Sections it never reaches can't be seen.
+// This is Tommaso Checchi's "advanced cave culling". It reads only the
+// SectionConnectivity computed while meshing, so nothing waits on the GPU.
+class CaveCuller {
+public:
+    CaveCuller();
+
+    // Searches the square of size x size Chunks whose corner is
+    // (minX, minZ), visiting only sections inside frustum. If the camera
+    // is outside the square or above or below the world, every section
+    // counts as visible.
+    void update(const Terrain &terrain, glm::vec3 eye, const Frustum &frustum,
+                int minX, int minZ, int size);
+    // The sections of the Chunk whose corner is (x, z) that the last
+    // update() reached, bit s for section s
+    uint16_t visibleSections(int x, int z) const;
+
+private:
+    struct Step {
+        int chunk;       // Index into m_chunks and m_visible
+        int section;
+        Direction entry; // The face it was entered through
+        uint8_t dirs;    // Bit d is set if the path so far moved in Direction d
+    };
+
+    int m_minX, m_minZ, m_size;
+    bool m_everythingVisible;
+    // The square's Chunks, row by row in z; nullptr where there is none
+    std::vector<const Chunk*> m_chunks;
+    // The sections reached in each Chunk; also marks them visited
+    std::vector<uint16_t> m_visible;
+    std::vector<Step> m_queue;
+};
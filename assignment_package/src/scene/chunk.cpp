@@ -1,15 +1,66 @@
 #include "chunk.h"
+#include "chunkuploadqueue.h"
+#include "profiler.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 
+ChunkOccupancy::ChunkOccupancy()
+    : heights(), layerCounts(), sectionCounts(), transparentCounts()
+{}
 
-Chunk::Chunk(int x, int z, OpenGLContext* context) : Drawable(context), m_blocks(), minX(x), minZ(z),
-    m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}}, vbo_created(false)
+void ChunkOccupancy::replace(int y, int count, BlockType from, BlockType to) {
+    int solid = (to != EMPTY) - (from != EMPTY);
+    int water = (to == WATER) - (from == WATER);
+    if (solid == 0 && water == 0) {
+        return;
+    }
+    for (int i = y; i < y + count; i++) {
+        layerCounts[i] += solid;
+    }
+    // Each section the run overlaps gains or loses that many blocks
+    for (int i = y; i < y + count;) {
+        int end = std::min(y + count, (i | 15) + 1);
+        sectionCounts[i >> 4] += solid * (end - i);
+        transparentCounts[i >> 4] += water * (end - i);
+        i = end;
+    }
+}
+
+int ChunkOccupancy::minY() const {
+    int y = 0;
+    while (y < 256 && layerCounts[y] == 0) {
+        y++;
+    }
+    return y;
+}
+
+int ChunkOccupancy::maxY() const {
+    int y = 255;
+    while (y >= 0 && layerCounts[y] == 0) {
+        y--;
+    }
+    return y;
+}
+
+Chunk::Chunk(int x, int z, OpenGLContext* context, ChunkArena *arena) : Drawable(context), m_blocks(EMPTY), m_blocksMutex(), m_occupancy(),
+    minX(x), minZ(z),
+    m_neighbors{},
+    mp_arena(arena), m_allocation(), m_transQuadOffset(0), m_sectionMeshes(), m_dirtySections(0xFFFF), m_meshMutex(),
+    m_meshVersion(0), m_boundVersion(0), m_sectionIdx(), m_sectionIdxTrans(),
+    m_boundsMinY(256), m_boundsMaxY(-1), m_connectivity(), m_state(REQUESTED),
+    blocks_dirty(false)
 {
-    std::fill_n(m_blocks.begin(), 65536, EMPTY);
+    m_connectivity.fill(SECTION_ALL_CONNECTED);
+}
+
+Chunk::~Chunk() {
+    mp_arena->release(m_allocation);
 }
 
-// Does bounds checking with at()
+// Does bounds checking like std::array::at()
 BlockType Chunk::getBlockAt(unsigned int x, unsigned int y, unsigned int z) const {
-    return m_blocks.at(x + 16 * y + 16 * 256 * z);
+    return m_blocks.getChecked(x, y, z);
 }
 
 // Exists to get rid of compiler warnings about int -> unsigned int implicit conversion
@@ -17,372 +68,632 @@ BlockType Chunk::getBlockAt(int x, int y, int z) const {
     return getBlockAt(static_cast<unsigned int>(x), static_cast<unsigned int>(y), static_cast<unsigned int>(z));
 }
 
-// Does bounds checking with at()
+// A block on the top or bottom layer of its section also decides which
+// faces show in the section next to it
+static uint16_t sectionsAffectedBy(int yStart, int yEnd) {
+    int lo = std::max(yStart - 1, 0) >> 4;
+    int hi = std::min(yEnd, 255) >> 4;
+    return static_cast<uint16_t>(((2u << hi) - 1) & ~((1u << lo) - 1));
+}
+
+// Does bounds checking like std::array::at()
 void Chunk::setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
-    m_blocks.at(x + 16 * y + 16 * 256 * z) = t;
+    ChunkBlocks::checkIndex(x, y, z);
+    std::unique_lock<std::shared_mutex> lock(m_blocksMutex);
+    occupyColumn(x, z, y, y + 1, t);
+    m_blocks.set(x, y, z, t);
+    updateColumnHeight(x, z, y, y + 1, t);
+    blocks_dirty = true;
+    m_dirtySections |= sectionsAffectedBy(y, y + 1);
 }
 
+void Chunk::fillColumn(int x, int z, int yStart, int yEnd, BlockType t) {
+    if (yStart >= yEnd) {
+        return;
+    }
+    ChunkBlocks::checkIndex(x, yStart, z);
+    ChunkBlocks::checkIndex(x, yEnd - 1, z);
+    std::unique_lock<std::shared_mutex> lock(m_blocksMutex);
+    occupyColumn(x, z, yStart, yEnd, t);
+    m_blocks.fillColumn(x, z, yStart, yEnd, t);
+    updateColumnHeight(x, z, yStart, yEnd, t);
+    blocks_dirty = true;
+    m_dirtySections |= sectionsAffectedBy(yStart, yEnd);
+}
 
-const static std::unordered_map<Direction, Direction, EnumHash> oppositeDirection {
-    {XPOS, XNEG},
-    {XNEG, XPOS},
-    {YPOS, YNEG},
-    {YNEG, YPOS},
-    {ZPOS, ZNEG},
-    {ZNEG, ZPOS}
-};
+void Chunk::setColumn(int x, int z, int yStart, const BlockType *types, int count) {
+    if (count <= 0) {
+        return;
+    }
+    ChunkBlocks::checkIndex(x, yStart, z);
+    ChunkBlocks::checkIndex(x, yStart + count - 1, z);
+    std::unique_lock<std::shared_mutex> lock(m_blocksMutex);
+    for (int i = 0; i < count;) {
+        int run = 1;
+        while (i + run < count && types[i + run] == types[i]) {
+            run++;
+        }
+        occupyColumn(x, z, yStart + i, yStart + i + run, types[i]);
+        m_blocks.fillColumn(x, z, yStart + i, yStart + i + run, types[i]);
+        updateColumnHeight(x, z, yStart + i, yStart + i + run, types[i]);
+        i += run;
+    }
+    blocks_dirty = true;
+    m_dirtySections |= sectionsAffectedBy(yStart, yStart + count);
+}
 
-void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
-    if(neighbor != nullptr) {
-        this->m_neighbors[dir] = neighbor.get();
-        neighbor->m_neighbors[oppositeDirection.at(dir)] = this;
-    }
-}
-
-std::vector<glm::vec4> Chunk::findFace(glm::ivec3 n) {
-    std::vector<glm::vec4> result;
-    if (n.x == 1) {
-        result.push_back(glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-    }
-    if (n.x == -1) {
-        result.push_back(glm::vec4(0.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-    }
-    if (n.y == 1) {
-        result.push_back(glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-    }
-    if (n.y == -1) {
-        result.push_back(glm::vec4(1.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
-    }
-    if (n.z == 1) {
-        result.push_back(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 1.0f, 1.0f));
-    }
-    if (n.z == -1) {
-        result.push_back(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
+void Chunk::occupyColumn(int x, int z, int yStart, int yEnd, BlockType t) {
+    // Everything from the column's height up is EMPTY, and so is all of a
+    // uniform EMPTY section, so only the rest has to be read
+    int height = m_occupancy.heights[x + 16 * z];
+    for (int y = yStart; y < yEnd;) {
+        if (y >= height) {
+            m_occupancy.replace(y, yEnd - y, EMPTY, t);
+            return;
+        }
+        int end = std::min(yEnd, (y | 15) + 1);
+        const auto &section = m_blocks.sectionAt(x, y, z);
+        if (section.isUniform()) {
+            m_occupancy.replace(y, end - y, section.uniformType(), t);
+            y = end;
+            continue;
+        }
+        for (; y < end; y++) {
+            m_occupancy.replace(y, 1, m_blocks.get(x, y, z), t);
+        }
     }
-    return result;
 }
 
-glm::vec3 Chunk::findColor(BlockType t) {
-    switch(t) {
-        case GRASS:
-            return glm::vec3(95.f, 159.f, 53.f) / 255.f;
-        case DIRT:
-            return glm::vec3(121.f, 85.f, 58.f) / 255.f;
-        case STONE:
-            return glm::vec3(0.5f);
-        case WATER:
-            return glm::vec3(0.f, 0.f, 0.75f);
-        case SNOW:
-            return glm::vec3(1.f, 1.f, 1.f);
-        default:
-            // Other block types are not yet handled, so we default to debug purple
-            return glm::vec3(1.f, 0.f, 1.f);
-    }
-}
-
-std::vector<glm::vec4> Chunk::findUV(BlockType t, glm::ivec3 n) {
-    std::vector<glm::vec4> results;
-    switch(t) {
-        case GRASS:
-            if (n.y == 1) {
-                results.push_back(glm::vec4(8.f, 14.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(8.f, 13.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(9.f, 13.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(9.f, 14.f, 0, 0) / 16.f);
-            }
-            else if (n.y == -1) {
-                results.push_back(glm::vec4(2.f, 16.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(2.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(3.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(3.f, 16.f, 0, 0) / 16.f);
-            }
-            else {
-                results.push_back(glm::vec4(3.f, 16.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(3.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(4.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(4.f, 16.f, 0, 0) / 16.f);
-            }
-        case DIRT:
-            results.push_back(glm::vec4(3.f, 16.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(3.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(4.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(4.f, 16.f, 0, 0) / 16.f);
-        case STONE:
-            results.push_back(glm::vec4(1.f, 16.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(1.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(2.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(2.f, 16.f, 0, 0) / 16.f);
-        case WATER:
-            results.push_back(glm::vec4(13.f, 4.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(13.f, 3.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(14.f, 3.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(14.f, 4.f, 0, 0) / 16.f);
-        case SNOW:
-            results.push_back(glm::vec4(2.f, 12.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(2.f, 11.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(3.f, 11.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(3.f, 12.f, 0, 0) / 16.f);
-        default:
-            results.push_back(glm::vec4(7.f, 2.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(7.f, 1.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(8.f, 1.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(8.f, 2.f, 0, 0) / 16.f);
-    }
-    return results;
-}
-
-bool Chunk::checkBound(int x, int y, int z) {
-    if (x < 0 || x > 15) {
-        return false;
-    } else if (y < 0 || y > 255) {
-        return false;
-    } else if (z < 0 || z > 15) {
-        return false;
+void Chunk::updateColumnHeight(int x, int z, int yStart, int yEnd, BlockType t) {
+    uint16_t &height = m_occupancy.heights[x + 16 * z];
+    if (t != EMPTY) {
+        height = std::max<int>(height, yEnd);
+        return;
     }
-    return true;
+    if (height <= yStart || height > yEnd) {
+        return;
+    }
+    // The column's top was cleared: look down for the next block, skipping
+    // layers that have none in any column
+    int y = yStart - 1;
+    while (y >= 0 && (m_occupancy.layerCounts[y] == 0 || m_blocks.get(x, y, z) == EMPTY)) {
+        y--;
+    }
+    height = y + 1;
 }
 
-bool Chunk::checkNeighbor(int x, int y, int z, BlockType t) {
-    if (t == WATER) return false;
-    if (x == -1) {
-        if (m_neighbors[XNEG]) {
-            if (m_neighbors[XNEG]->getBlockAt(15, y, z) == EMPTY ||
-                m_neighbors[XNEG]->getBlockAt(15, y, z) == WATER) return true;
-            return false;
-        } else {
-            return true;
+int Chunk::columnHeight(int x, int z) const {
+    return m_occupancy.heights[x + 16 * z];
+}
+
+int Chunk::minBlockY() const {
+    std::shared_lock<std::shared_mutex> lock(m_blocksMutex);
+    return m_occupancy.minY();
+}
+
+int Chunk::maxBlockY() const {
+    std::shared_lock<std::shared_mutex> lock(m_blocksMutex);
+    return m_occupancy.maxY();
+}
+
+int Chunk::sectionBlockCount(int s) const {
+    return m_occupancy.sectionCounts[s];
+}
+
+int Chunk::sectionTransparentCount(int s) const {
+    return m_occupancy.transparentCounts[s];
+}
+
+void Chunk::compactBlocks() {
+    std::unique_lock<std::shared_mutex> lock(m_blocksMutex);
+    m_blocks.compact();
+}
+
+size_t Chunk::blockBytes() const {
+    std::shared_lock<std::shared_mutex> lock(m_blocksMutex);
+    return m_blocks.memoryUsage();
+}
+
+std::vector<unsigned char> Chunk::encodeBlocks() const {
+    std::vector<unsigned char> out;
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            int y = 0;
+            while (y < 256) {
+                BlockType t = m_blocks.get(x, y, z);
+                int run = 1;
+                while (y + run < 256 && m_blocks.get(x, y + run, z) == t) {
+                    run++;
+                }
+                out.push_back(t);
+                out.push_back(static_cast<unsigned char>(run - 1));
+                y += run;
+            }
         }
     }
-    if (x == 16) {
-        if (m_neighbors[XPOS]) {
-            if (m_neighbors[XPOS]->getBlockAt(0, y, z) == EMPTY ||
-                m_neighbors[XPOS]->getBlockAt(0, y, z) == WATER) return true;
-            return false;
-        } else {
-            return true;
+    return out;
+}
+
+bool Chunk::decodeBlocks(const std::vector<unsigned char> &data) {
+    ChunkBlocks blocks(EMPTY);
+    ChunkOccupancy occupancy;
+    size_t i = 0;
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            int y = 0;
+            while (y < 256) {
+                if (i + 1 >= data.size()) {
+                    return false;
+                }
+                // A byte past the last BlockType means a corrupt file
+                if (data[i] > BEDROCK) {
+                    return false;
+                }
+                BlockType t = static_cast<BlockType>(data[i]);
+                int run = data[i + 1] + 1;
+                i += 2;
+                if (y + run > 256) {
+                    return false;
+                }
+                blocks.fillColumn(x, z, y, y + run, t);
+                occupancy.replace(y, run, EMPTY, t);
+                if (t != EMPTY) {
+                    occupancy.heights[x + 16 * z] = y + run;
+                }
+                y += run;
+            }
         }
     }
-    if (z == -1) {
-        if (m_neighbors[ZNEG]) {
-            if (m_neighbors[ZNEG]->getBlockAt(x, y, 15) == EMPTY ||
-                m_neighbors[ZNEG]->getBlockAt(x, y, 15) == WATER) return true;
-            return false;
-        } else {
-            return true;
-        }
+    if (i != data.size()) {
+        return false;
     }
-    if (z == 16) {
-        if (m_neighbors[ZPOS]) {
-            if (m_neighbors[ZPOS]->getBlockAt(x, y, 0) == EMPTY ||
-                m_neighbors[ZPOS]->getBlockAt(x, y, 0)  == WATER) return true;
-            return false;
-        } else {
-            return true;
+    blocks.compact();
+    std::unique_lock<std::shared_mutex> lock(m_blocksMutex);
+    m_blocks = std::move(blocks);
+    m_occupancy = occupancy;
+    m_dirtySections = 0xFFFF;
+    return true;
+}
+
+
+void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
+    if(neighbor != nullptr) {
+        this->m_neighbors[dir] = neighbor.get();
+        neighbor->m_neighbors[oppositeDirection[dir]] = this;
+    }
+}
+
+void Chunk::unlinkNeighbors() {
+    for (int dir = 0; dir < 6; dir++) {
+        if (m_neighbors[dir] != nullptr) {
+            m_neighbors[dir]->m_neighbors[oppositeDirection[dir]] = nullptr;
+            m_neighbors[dir] = nullptr;
         }
     }
-    if (y == -1 || y == 256) {
-        return true;
+}
+
+const std::array<Chunk*, 6>& Chunk::getNeighbors() const {
+    return m_neighbors;
+}
+
+void Chunk::releaseVBOdata() {
+    mp_arena->release(m_allocation);
+    m_count = -1;
+    m_count_trans = -1;
+    std::lock_guard<std::mutex> lock(m_meshMutex);
+    for (ChunkSectionMesh &m : m_sectionMeshes) {
+        m = ChunkSectionMesh();
     }
-    return false;
+    m_dirtySections = 0xFFFF;
 }
 
-bool Chunk::checkConidtions(int x, int y, int z, const glm::ivec3& n, BlockType t) {
-    if (checkNeighbor(x+n.x, y+n.y, z+n.z, t)) {
-        return true;
-    } else if (checkBound(x+n.x, y+n.y, z+n.z)) {
-        if (getBlockAt(x+n.x, y+n.y, z+n.z) == EMPTY) {
-            return true;
-        } else if (t != WATER && getBlockAt(x+n.x, y+n.y, z+n.z) == WATER) {
-            return true;
-        }
+void Chunk::invalidateMesh() {
+    m_dirtySections = 0xFFFF;
+}
+
+void Chunk::markSectionsDirty(uint16_t sections) {
+    m_dirtySections |= sections;
+}
+
+bool Chunk::hasDirtySections() const {
+    return m_dirtySections != 0;
+}
+
+size_t Chunk::meshBytes() const {
+    std::lock_guard<std::mutex> lock(m_meshMutex);
+    size_t bytes = 0;
+    for (const ChunkSectionMesh &m : m_sectionMeshes) {
+        bytes += (m.opaque.capacity() + m.trans.capacity()) * sizeof(ChunkVertex);
     }
-    return false;
+    return bytes;
 }
 
-void Chunk::bindBuffer(const std::vector<glm::vec4> &d, const std::vector<glm::vec4> &d_trans,
-                       const std::vector<GLuint> &i, const std::vector<GLuint> &i_trans) {
-    m_count = i.size();
-    m_count_trans = i_trans.size();
-    generateIdx();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), i.data(), GL_STATIC_DRAW);
+std::pair<GLuint, GLuint> Chunk::sectionIndexRange(int section, bool transparent) const {
+    const auto &first = transparent ? m_sectionIdxTrans : m_sectionIdx;
+    return {first[section], first[section + 1] - first[section]};
+}
 
-    generateIdxTrans();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxTrans);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count_trans * sizeof(GLuint), i_trans.data(), GL_STATIC_DRAW);
+int Chunk::arenaPage() const {
+    return m_allocation.page;
+}
 
-    generateInter();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufInter);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, d.size() * sizeof(glm::vec4), d.data(), GL_STATIC_DRAW);
+GLint Chunk::arenaBaseVertex(bool transparent) const {
+    return (m_allocation.firstQuad + (transparent ? m_transQuadOffset : 0)) * 4;
+}
 
-    generateInterTrans();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufInterTrans);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, d_trans.size() * sizeof(glm::vec4), d_trans.data(), GL_STATIC_DRAW);
+void Chunk::bindBuffer(const ChunkVBOData &v) {
+    if (v.version < m_boundVersion) {
+        return;
+    }
+    m_boundVersion = v.version;
+    m_sectionIdx = v.sectionIdx;
+    m_sectionIdxTrans = v.sectionIdxTrans;
+    m_boundsMinY = v.minY;
+    m_boundsMaxY = v.maxY;
+    m_connectivity = v.connectivity;
+    const std::vector<ChunkVertex> &d = v.d, &d_trans = v.d_trans;
+    m_count = d.size() / 4 * 6;
+    m_count_trans = d_trans.size() / 4 * 6;
+    // The new mesh rarely has the old one's size, so it takes a new range
+    // of the arena; first fit usually hands back the one just released
+    mp_arena->release(m_allocation);
+    m_transQuadOffset = d.size() / 4;
+    m_allocation = mp_arena->allocate((d.size() + d_trans.size()) / 4);
+    mp_arena->upload(m_allocation, 0, d.size() / 4, d.data());
+    mp_arena->upload(m_allocation, m_transQuadOffset, d_trans.size() / 4, d_trans.data());
 
-    buffer_created = true;
+    m_state = UPLOADED;
 }
 
 glm::vec2 Chunk::getMins() {
     return glm::vec2(minX, minZ);
 }
 
+AABB Chunk::getBounds() const {
+    return AABB{glm::vec3(minX, m_boundsMinY, minZ), glm::vec3(minX + 16, m_boundsMaxY, minZ + 16)};
+}
 
-void Chunk::createVBOdata() {
-    std::vector<glm::vec4> data;
-    std::vector<glm::vec4> data_trans;
-    std::vector<GLuint> indices;
-    std::vector<GLuint> indices_trans;
-    int curSize = 0;
-    int curSize_trans = 0;
-    std::vector<glm::ivec3> neighbors = {glm::ivec3(1, 0, 0),
-                                        glm::ivec3(-1, 0, 0),
-                                        glm::ivec3(0, 1, 0),
-                                        glm::ivec3(0, -1, 0),
-                                        glm::ivec3(0, 0, 1),
-                                        glm::ivec3(0, 0, -1)};
-
-    for (int x = 0; x < 16; x++) {
-        for (int y = 0; y < 256; y++) {
-            for (int z = 0; z < 16; z++) {
-                BlockType t = getBlockAt(x, y, z);
-                if (t != EMPTY) {
-                    for (auto const& n:neighbors) {
-                        if (checkConidtions(x, y, z, n, t)) {
-                            auto offsets = findFace(n);
-                            auto UVs = findUV(t, n);
-                            if (t == WATER && n.y != 1) continue; // ensure only draw the water level
-                            if (t == WATER) {
-                                for (int i = 0; i < 4; i++) {
-                                    data_trans.push_back(glm::vec4(x+ this->minX, y, z + this->minZ, 0.) + offsets[i]);
-                                    data_trans.push_back(glm::vec4(n, 1.));
-                                    data_trans.push_back(glm::vec4(findColor(t), 1.));
-                                    data_trans.push_back(UVs[i]);
-                                }
-                                indices_trans.push_back(curSize_trans);
-                                indices_trans.push_back(curSize_trans + 1);
-                                indices_trans.push_back(curSize_trans + 2);
-                                indices_trans.push_back(curSize_trans);
-                                indices_trans.push_back(curSize_trans + 2);
-                                indices_trans.push_back(curSize_trans + 3);
-                                curSize_trans += 4;
-                            } else {
-                                for (int i = 0; i < 4; i++) {
-                                    data.push_back(glm::vec4(x + this->minX, y, z + this->minZ, 0.) + offsets[i]);
-                                    data.push_back(glm::vec4(n, 1.));
-                                    data.push_back(glm::vec4(findColor(t), 1.));
-                                    data.push_back(UVs[i]);
-                                }
-                                indices.push_back(curSize);
-                                indices.push_back(curSize + 1);
-                                indices.push_back(curSize + 2);
-                                indices.push_back(curSize);
-                                indices.push_back(curSize + 2);
-                                indices.push_back(curSize + 3);
-                                curSize += 4;
+SectionConnectivity Chunk::getSectionConnectivity(int section) const {
+    return m_connectivity[section];
+}
+
+
+std::atomic<bool> Chunk::greedyMeshing(CHUNK_GREEDY_MESHING);
+
+static const std::array<glm::ivec3, 6> faceNormals = {glm::ivec3(1, 0, 0),
+                                                      glm::ivec3(-1, 0, 0),
+                                                      glm::ivec3(0, 1, 0),
+                                                      glm::ivec3(0, -1, 0),
+                                                      glm::ivec3(0, 0, 1),
+                                                      glm::ivec3(0, 0, -1)};
+
+void Chunk::copyPaddedSection(int section, PaddedSection &out) const {
+    // Outside the world counts as WATER: solid faces show against it and
+    // water's top doesn't, which is how the world's edges always meshed.
+    // A missing or ungenerated neighbor counts as EMPTY, and so does
+    // anything at or above its column's height.
+    auto outside = [this](int x, int y, int z) -> BlockType {
+        if (y < 0 || y > 255) {
+            return WATER;
+        }
+        Direction dir;
+        if (x < 0 || x > 15) {
+            if (z < 0 || z > 15) {
+                return EMPTY;
+            }
+            dir = x < 0 ? XNEG : XPOS;
+        } else {
+            dir = z < 0 ? ZNEG : ZPOS;
+        }
+        const Chunk *n = m_neighbors[dir];
+        x &= 15;
+        z &= 15;
+        if (n == nullptr || !n->hasBlocks() || y >= n->columnHeight(x, z)) {
+            return EMPTY;
+        }
+        return n->m_blocks.get(x, y, z);
+    };
+    m_blocks.copyPaddedSection(0, section, 0, out, outside,
+                               [this](int x, int z) { return columnHeight(x, z); });
+}
+
+void Chunk::appendFace(ChunkSectionMesh &out, const glm::ivec3 &origin, const glm::ivec3 &size,
+                       Direction dir, BlockType t) {
+    std::vector<ChunkVertex> &data = (t == WATER) ? out.trans : out.opaque;
+    GLuint chunkBits = (static_cast<GLuint>(this->minX / 16) & 0xFFFF) |
+                       (static_cast<GLuint>(this->minZ / 16) << 16);
+    for (int i = 0; i < 4; i++) {
+        const int *c = faceCorners[dir][i];
+        int y = origin.y + c[1] * size.y;
+        GLuint bits = (origin.x + c[0] * size.x) | (y << 5) |
+                      ((origin.z + c[2] * size.z) << 14) | (dir << 19) | (t << 22);
+        data.push_back(ChunkVertex{bits, chunkBits});
+        out.minY = std::min(out.minY, y);
+        out.maxY = std::max(out.maxY, y);
+    }
+}
+
+void Chunk::meshFaces(ChunkSectionMesh &out, int section, const PaddedSection &blocks,
+                      const SectionFaceMasks &masks) {
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            for (int f = 0; f < 6; f++) {
+                for (uint32_t bits = masks.visible[f][x + 16 * z]; bits != 0; bits &= bits - 1) {
+                    int y = lowestBit(bits);
+                    appendFace(out, glm::ivec3(x, 16 * section + y, z), glm::ivec3(1), Direction(f),
+                               blocks[paddedIndex(x, y, z)]);
+                }
+            }
+        }
+    }
+}
+
+void Chunk::meshGreedy(ChunkSectionMesh &out, int section, const PaddedSection &blocks,
+                       const SectionFaceMasks &masks) {
+    // Quads don't cross into the sections above and below, so each
+    // section's mesh only depends on its own blocks and their neighbors
+    const glm::ivec3 base(0, 16 * section, 0);
+    std::array<BlockType, 16 * 16> mask;
+    for (int f = 0; f < 6; f++) {
+        const glm::ivec3 &n = faceNormals[f];
+        int dAxis = n.x != 0 ? 0 : (n.y != 0 ? 1 : 2);
+        int uAxis = (dAxis + 1) % 3;
+        int vAxis = (dAxis + 2) % 3;
+
+        for (int d = 0; d < 16; d++) {
+            if (!((masks.slices[f] >> d) & 1)) {
+                continue;
+            }
+            // Record the type of every visible face in this slice
+            glm::ivec3 p(0);
+            p[dAxis] = d;
+            for (int v = 0; v < 16; v++) {
+                for (int u = 0; u < 16; u++) {
+                    p[uAxis] = u;
+                    p[vAxis] = v;
+                    bool visible = (masks.visible[f][p.x + 16 * p.z] >> p.y) & 1;
+                    mask[u + 16 * v] = visible ? blocks[paddedIndex(p.x, p.y, p.z)] : EMPTY;
+                }
+            }
+            // Grow each unvisited face along u, then along v, and emit the rectangle
+            for (int v = 0; v < 16; v++) {
+                for (int u = 0; u < 16;) {
+                    BlockType t = mask[u + 16 * v];
+                    if (t == EMPTY) {
+                        u++;
+                        continue;
+                    }
+                    int w = 1;
+                    while (u + w < 16 && mask[u + w + 16 * v] == t) {
+                        w++;
+                    }
+                    int h = 1;
+                    for (; v + h < 16; h++) {
+                        bool rowMatches = true;
+                        for (int k = 0; k < w; k++) {
+                            if (mask[u + k + 16 * (v + h)] != t) {
+                                rowMatches = false;
+                                break;
                             }
-                        } else {
-                            continue;
                         }
+                        if (!rowMatches) break;
                     }
-                } else {
-                    continue;
+                    for (int j = 0; j < h; j++) {
+                        std::fill_n(mask.begin() + u + 16 * (v + j), w, EMPTY);
+                    }
+
+                    glm::ivec3 origin, size(1);
+                    origin[dAxis] = d;
+                    origin[uAxis] = u;
+                    origin[vAxis] = v;
+                    size[uAxis] = w;
+                    size[vAxis] = h;
+                    appendFace(out, base + origin, size, Direction(f), t);
+                    u += w;
                 }
             }
         }
     }
-    vbo_created  = true;
-    bindBuffer(data, data_trans, indices, indices_trans);
-}
-
-void Chunk::generateVBO(std::vector<ChunkVBOData> &vboData, std::mutex &mu) {
-    std::vector<glm::vec4> data;
-    std::vector<glm::vec4> data_trans;
-    std::vector<GLuint> indices;
-    std::vector<GLuint> indices_trans;
-    int curSize = 0;
-    int curSize_trans = 0;
-    std::vector<glm::ivec3> neighbors = {glm::ivec3(1, 0, 0),
-                                        glm::ivec3(-1, 0, 0),
-                                        glm::ivec3(0, 1, 0),
-                                        glm::ivec3(0, -1, 0),
-                                        glm::ivec3(0, 0, 1),
-                                        glm::ivec3(0, 0, -1)};
-
-    for (int x = 0; x < 16; x++) {
-        for (int y = 0; y < 256; y++) {
-            for (int z = 0; z < 16; z++) {
-                BlockType t = getBlockAt(x, y, z);
-                if (t != EMPTY) {
-                    for (auto const& n:neighbors) {
-                        if (checkConidtions(x, y, z, n, t)) {
-                            auto offsets = findFace(n);
-                            auto UVs = findUV(t, n);
-                            if (t == WATER && n.y != 1) continue; // ensure only draw the water level
-                            if (t == WATER) {
-                                for (int i = 0; i < 4; i++) {
-                                    data_trans.push_back(glm::vec4(x+ this->minX, y, z + this->minZ, 0.) + offsets[i]);
-                                    data_trans.push_back(glm::vec4(n, 1.));
-                                    data_trans.push_back(glm::vec4(findColor(t), 1.));
-                                    data_trans.push_back(UVs[i]);
-                                }
-                                indices_trans.push_back(curSize_trans);
-                                indices_trans.push_back(curSize_trans + 1);
-                                indices_trans.push_back(curSize_trans + 2);
-                                indices_trans.push_back(curSize_trans);
-                                indices_trans.push_back(curSize_trans + 2);
-                                indices_trans.push_back(curSize_trans + 3);
-                                curSize_trans += 4;
-                            } else {
-                                for (int i = 0; i < 4; i++) {
-                                    data.push_back(glm::vec4(x + this->minX, y, z + this->minZ, 0.) + offsets[i]);
-                                    data.push_back(glm::vec4(n, 1.));
-                                    data.push_back(glm::vec4(findColor(t), 1.));
-                                    data.push_back(UVs[i]);
-                                }
-                                indices.push_back(curSize);
-                                indices.push_back(curSize + 1);
-                                indices.push_back(curSize + 2);
-                                indices.push_back(curSize);
-                                indices.push_back(curSize + 2);
-                                indices.push_back(curSize + 3);
-                                curSize += 4;
-                            }
-                        } else {
-                            continue;
+}
+
+static bool seeThrough(BlockType t) {
+    return t == EMPTY || t == WATER;
+}
+
+SectionConnectivity Chunk::computeConnectivity(int section, const PaddedSection &blocks) const {
+    // Sections that are all solid or all see-through need no fill
+    int solid = m_occupancy.sectionCounts[section] - m_occupancy.transparentCounts[section];
+    if (solid == 0) {
+        return SECTION_ALL_CONNECTED;
+    }
+    if (solid == 16 * 16 * 16) {
+        return 0;
+    }
+    // Laid out like PaddedSection: 1 marks an unvisited see-through block,
+    // 0 a solid or visited one, and the border around the section holds
+    // FACE + d on face d, so the fill needs no bounds checks
+    const uint8_t FACE = 2;
+    std::array<uint8_t, 18 * 18 * 18> cells;
+    cells.fill(0);
+    int openCount = 0;
+    for (int a = 0; a < 16; a++) {
+        for (int b = 0; b < 16; b++) {
+            cells[paddedIndex(16, a, b)] = FACE + XPOS;
+            cells[paddedIndex(-1, a, b)] = FACE + XNEG;
+            cells[paddedIndex(a, 16, b)] = FACE + YPOS;
+            cells[paddedIndex(a, -1, b)] = FACE + YNEG;
+            cells[paddedIndex(a, b, 16)] = FACE + ZPOS;
+            cells[paddedIndex(a, b, -1)] = FACE + ZNEG;
+            for (int y = 0; y < 16; y++) {
+                int i = paddedIndex(a, y, b);
+                cells[i] = seeThrough(blocks[i]);
+                openCount += cells[i];
+            }
+        }
+    }
+    if (openCount == 0) {
+        return 0;
+    }
+    if (openCount == 4096) {
+        return SECTION_ALL_CONNECTED;
+    }
+
+    // Every block is pushed at most once, since it is closed when pushed
+    const int offsets[6] = {18, -18, 1, -1, 18 * 18, -18 * 18};
+    SectionConnectivity result = 0;
+    std::array<uint16_t, 4096> stack;
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            for (int y = 0; y < 16; y++) {
+                int seed = paddedIndex(x, y, z);
+                if (cells[seed] != 1) {
+                    continue;
+                }
+                int top = 0;
+                stack[top++] = seed;
+                cells[seed] = 0;
+                unsigned int faces = 0;
+                while (top > 0) {
+                    int i = stack[--top];
+                    for (int offset : offsets) {
+                        uint8_t c = cells[i + offset];
+                        if (c == 1) {
+                            cells[i + offset] = 0;
+                            stack[top++] = i + offset;
+                        } else if (c >= FACE) {
+                            faces |= 1 << (c - FACE);
                         }
                     }
-                } else {
+                }
+                for (int d = 0; d < 6; d++) {
+                    if (faces & (1 << d)) {
+                        result |= static_cast<SectionConnectivity>(faces) << (6 * d);
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+void Chunk::buildVBOdata(ChunkVBOData &out) {
+    PROFILE_SCOPE("Chunk::buildVBOdata");
+    std::lock_guard<std::mutex> meshLock(m_meshMutex);
+    // Edits made from here on mark their sections again, so nothing
+    // written while we mesh is lost
+    uint16_t dirty = m_dirtySections.exchange(0);
+    if (dirty != 0) {
+        // Keep these blocks and the neighbors' from being rewritten while we
+        // read them. Locking in address order means two Chunks meshing at
+        // once can't each hold what the other is waiting for.
+        std::array<Chunk*, 5> chunks = {this, m_neighbors.at(XPOS), m_neighbors.at(XNEG),
+                                        m_neighbors.at(ZPOS), m_neighbors.at(ZNEG)};
+        std::sort(chunks.begin(), chunks.end());
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        for (Chunk *c : chunks) {
+            if (c != nullptr) {
+                locks.emplace_back(c->m_blocksMutex);
+            }
+        }
+
+        PaddedSection padded;
+        SectionFaceMasks masks;
+        // A section cleared below but not finished would keep its partial
+        // mesh on the retry, so if meshing throws they are all dirty again
+        try {
+            for (int s = 0; s < CHUNK_SECTIONS; s++) {
+                if (!(dirty & (1 << s))) {
                     continue;
                 }
+                ChunkSectionMesh &mesh = m_sectionMeshes[s];
+                mesh.opaque.clear();
+                mesh.trans.clear();
+                mesh.minY = 256;
+                mesh.maxY = -1;
+                // Air has no faces and connects everything
+                if (m_occupancy.sectionCounts[s] == 0) {
+                    mesh.connectivity = SECTION_ALL_CONNECTED;
+                    continue;
+                }
+                copyPaddedSection(s, padded);
+                mesh.connectivity = computeConnectivity(s, padded);
+                computeFaceMasks(padded, masks);
+                if (greedyMeshing) {
+                    meshGreedy(mesh, s, padded, masks);
+                } else {
+                    meshFaces(mesh, s, padded, masks);
+                }
             }
+        } catch (...) {
+            m_dirtySections |= dirty;
+            throw;
         }
     }
+
+    out.chunk = this;
+    out.version = ++m_meshVersion;
+    size_t verts = 0, vertsTrans = 0;
+    out.minY = 256;
+    out.maxY = -1;
+    for (const ChunkSectionMesh &mesh : m_sectionMeshes) {
+        verts += mesh.opaque.size();
+        vertsTrans += mesh.trans.size();
+        out.minY = std::min(out.minY, mesh.minY);
+        out.maxY = std::max(out.maxY, mesh.maxY);
+    }
+    out.d.reserve(verts);
+    out.d_trans.reserve(vertsTrans);
+    for (int s = 0; s < CHUNK_SECTIONS; s++) {
+        const ChunkSectionMesh &mesh = m_sectionMeshes[s];
+        out.connectivity[s] = mesh.connectivity;
+        out.sectionIdx[s] = out.d.size() / 4 * 6;
+        out.sectionIdxTrans[s] = out.d_trans.size() / 4 * 6;
+        out.d.insert(out.d.end(), mesh.opaque.begin(), mesh.opaque.end());
+        out.d_trans.insert(out.d_trans.end(), mesh.trans.begin(), mesh.trans.end());
+    }
+    out.sectionIdx[CHUNK_SECTIONS] = out.d.size() / 4 * 6;
+    out.sectionIdxTrans[CHUNK_SECTIONS] = out.d_trans.size() / 4 * 6;
+}
+
+void Chunk::createVBOdata() {
+    ChunkVBOData storedData;
+    buildVBOdata(storedData);
+    bindBuffer(storedData);
+}
+
+void Chunk::generateVBO(ChunkUploadQueue &uploads) {
     ChunkVBOData storedData;
-    storedData.chunk = this;
-    storedData.d = data;
-    storedData.d_trans = data_trans;
-    storedData.idx = indices;
-    storedData.idx_trans = indices_trans;
-
-    mu.lock();
-    vboData.push_back(storedData);
-    mu.unlock();
+    buildVBOdata(storedData);
+    // Before the push: once queued, the GUI thread may upload it and move
+    // the Chunk on to UPLOADED at any moment
+    m_state = MESHED;
+    uploads.push(std::move(storedData));
+}
+
+ChunkState Chunk::getState() const {
+    return m_state;
+}
+
+void Chunk::setState(ChunkState state) {
+    m_state = state;
+}
+
+bool Chunk::hasBlocks() const {
+    return m_state != REQUESTED;
+}
+
+bool Chunk::neighborsHaveBlocks() const {
+    if (!hasBlocks()) {
+        return false;
+    }
+    for (Direction dir : {XPOS, XNEG, ZPOS, ZNEG}) {
+        if (m_neighbors[dir] == nullptr || !m_neighbors[dir]->hasBlocks()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Chunk::hasGpuMesh() const {
+    return m_count >= 0;
 }
@@ -5,28 +5,24 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cstddef>
+#include <utility>
 #include "drawable.h"
+#include "voxelvolume.h"
+#include "frustum.h"
+#include "chunkarena.h"
 
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 
-
-//using namespace std;
-
-// C++ 11 allows us to define the size of an enum. This lets us use only one byte
-// of memory to store our different block types. By default, the size of a C++ enum
-// is that of an int (so, usually four bytes). This *does* limit us to only 256 different
-// block types, but in the scope of this project we'll never get anywhere near that many.
-enum BlockType : unsigned char
-{
-    EMPTY, GRASS, DIRT, STONE, WATER, SNOW, LAVA, BEDROCK
-};
-
-// The six cardinal directions in 3D space
-enum Direction : unsigned char
-{
-    XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
-};
+// Greedy meshing merges neighboring coplanar faces of the same BlockType into
+// one larger quad. Build with CHUNK_GREEDY_MESHING=0 to start with the original
+// one-quad-per-face mesher; either way it can be toggled at runtime through
+// Chunk::greedyMeshing.
+#ifndef CHUNK_GREEDY_MESHING
+#define CHUNK_GREEDY_MESHING 1
+#endif
 
 // Lets us use any enum class as the key of a
 // std::unordered_map
@@ -45,47 +41,250 @@ struct EnumHash {
 // to render the world block by block.
 
 struct ChunkVBOData;
+class ChunkUploadQueue;
+
+// A terrain vertex packed into 8 bytes and decoded in lambert.vert.glsl.
+// The normal, color and texture coordinates are all derived on the GPU
+// from the face direction, the BlockType and the position.
+// data:  chunk-local x (bits 0-4), y (bits 5-13), z (bits 14-18),
+//        face Direction (bits 19-21) and BlockType (bits 22-29)
+// chunk: the Chunk's minX / 16 in the low 16 bits and minZ / 16 in the
+//        high 16 bits, both signed
+struct ChunkVertex {
+    GLuint data;
+    GLuint chunk;
+};
+
+// A Chunk's blocks
+using ChunkBlocks = VoxelVolume<16, 256, 16>;
+
+// Chunks are meshed in 16-high sections, matching the 16x16x16 sections
+// their blocks are stored in, so an edit only remeshes the sections it touched
+#define CHUNK_SECTIONS 16
+
+// Which faces of a section can see each other through its EMPTY and WATER
+// blocks: bit 6 * a + b is set if such blocks connect face a to face b,
+// with a and b Directions. Lets CaveCuller skip sections that solid
+// terrain hides.
+using SectionConnectivity = uint64_t;
+#define SECTION_ALL_CONNECTED 0xFFFFFFFFFull
+inline bool facesConnected(SectionConnectivity c, Direction a, Direction b) {
+    return (c >> (6 * a + b)) & 1;
+}
+
+// The vertices of one section's mesh. A Chunk keeps these after uploading
+// so it can rebuild its buffers without remeshing the untouched sections.
+struct ChunkSectionMesh {
+    std::vector<ChunkVertex> opaque;
+    std::vector<ChunkVertex> trans;
+    // Lowest and highest vertex y; minY > maxY while there are no vertices
+    int minY = 256, maxY = -1;
+    SectionConnectivity connectivity = SECTION_ALL_CONNECTED;
+};
+
+// Where a Chunk is on its way from being created to being drawn. Terrain
+// moves it along one stage per checkTerrain, on the GUI thread except for
+// the two stages the workers finish.
+enum ChunkState : unsigned char
+{
+    REQUESTED,  // Created; its blocks are queued to be loaded or generated
+    GENERATED,  // Blocks filled in by a worker, not yet seen by Terrain
+    WAITING,    // Has blocks, but a neighbor doesn't yet
+    MESHABLE,   // It and its four neighbors have blocks, so it can be meshed
+    MESHING,    // A mesh task is queued or running; no second one is queued
+    MESHED,     // Mesh built by a worker, waiting in the upload queue
+    UPLOADED,   // Mesh on the GPU. An edit sends it back to MESHABLE.
+    EVICTABLE   // Out of range with its mesh freed; its zone may be unloaded
+};
+
+// Where a Chunk's non-EMPTY blocks are, kept up to date by every write so
+// meshing can skip empty ranges and ground queries needn't read blocks
+struct ChunkOccupancy {
+    // One above the highest non-EMPTY block of column x + 16 * z, 0 if the
+    // column is all EMPTY
+    std::array<uint16_t, 16 * 16> heights;
+    // Non-EMPTY blocks in each y layer and in each section, and WATER
+    // blocks in each section
+    std::array<uint16_t, 256> layerCounts;
+    std::array<uint16_t, CHUNK_SECTIONS> sectionCounts;
+    std::array<uint16_t, CHUNK_SECTIONS> transparentCounts;
+
+    ChunkOccupancy();
+    // Accounts for count blocks of one column, from y up, changing from
+    // type from to type to. Leaves heights alone.
+    void replace(int y, int count, BlockType from, BlockType to);
+    // Lowest and highest y holding a non-EMPTY block; minY() > maxY() if
+    // there are none
+    int minY() const;
+    int maxY() const;
+};
 
 class Chunk : public Drawable {
 private:
-    // All of the blocks contained within this Chunk
-    std::array<BlockType, 65536> m_blocks;
+    // All of the blocks contained within this Chunk, as sixteen 16x16x16
+    // sections with their own palettes
+    ChunkBlocks m_blocks;
+    // Held shared while a mesh is built from these blocks, and exclusively
+    // by setBlockAt, since a write can reallocate a section's storage
+    mutable std::shared_mutex m_blocksMutex;
+    // Summary of m_blocks, written under m_blocksMutex along with them
+    ChunkOccupancy m_occupancy;
     int minX, minZ;
-    // This Chunk's four neighbors to the north, south, east, and west
-    // The third input to this map just lets us use a Direction as
-    // a key for this map.
-    // These allow us to properly determine
-    std::unordered_map<Direction, Chunk*, EnumHash> m_neighbors;
+    // This Chunk's four neighbors to the north, south, east, and west,
+    // indexed by Direction. YPOS and YNEG are always nullptr.
+    std::array<Chunk*, 6> m_neighbors;
+    // Where the uploaded mesh lives: its opaque quads, then from
+    // m_transQuadOffset on its transparent ones
+    ChunkArena *mp_arena;
+    ChunkArena::Allocation m_allocation;
+    GLuint m_transQuadOffset;
 
+    // The last mesh built for each section
+    std::array<ChunkSectionMesh, CHUNK_SECTIONS> m_sectionMeshes;
+    // Bit s is set when section s has to be remeshed before the next upload
+    std::atomic<uint16_t> m_dirtySections;
+    // Held while the section meshes are rebuilt and put together
+    mutable std::mutex m_meshMutex;
+    // Numbers every mesh built, so a mesh still waiting to be uploaded
+    // can't replace a newer one that was bound in the meantime
+    uint64_t m_meshVersion;
+    uint64_t m_boundVersion;
+    // Index of the first element of each section in the index buffers;
+    // section s is drawn from m_sectionIdx[s] up to m_sectionIdx[s + 1]
+    std::array<GLuint, CHUNK_SECTIONS + 1> m_sectionIdx;
+    std::array<GLuint, CHUNK_SECTIONS + 1> m_sectionIdxTrans;
+    // Vertical extent of the mesh in the GPU buffers
+    int m_boundsMinY, m_boundsMaxY;
+    // Connectivity of each section, as of the mesh in the GPU buffers
+    std::array<SectionConnectivity, CHUNK_SECTIONS> m_connectivity;
+    // Read by the workers meshing this Chunk's neighbors
+    std::atomic<ChunkState> m_state;
 
+    // One section's blocks plus a one-block border from the sections above
+    // and below and the neighboring Chunks
+    void copyPaddedSection(int section, PaddedSection &out) const;
+    // Updates m_occupancy for the blocks of column (x, z) from yStart up
+    // to yEnd becoming t. Call with m_blocksMutex held, before writing them.
+    void occupyColumn(int x, int z, int yStart, int yEnd, BlockType t);
+    // Finds the column's new height after its blocks from yStart up to
+    // yEnd became t. Call once they are written.
+    void updateColumnHeight(int x, int z, int yStart, int yEnd, BlockType t);
+    // Flood fills the section's see-through blocks to find which faces
+    // they connect, unless the section is all one type
+    SectionConnectivity computeConnectivity(int section, const PaddedSection&) const;
+    // One quad per visible block face
+    void meshFaces(ChunkSectionMesh&, int section, const PaddedSection&, const SectionFaceMasks&);
+    // Visible faces merged into maximal rectangles per slice
+    void meshGreedy(ChunkSectionMesh&, int section, const PaddedSection&, const SectionFaceMasks&);
+    // Appends a quad covering size blocks starting at the chunk-space origin
+    void appendFace(ChunkSectionMesh&, const glm::ivec3 &origin, const glm::ivec3 &size,
+                    Direction, BlockType);
 
 public:
-    bool vbo_created=false;
-    bool buffer_created=false;
+    // Set by setBlockAt, cleared once the blocks are queued to be saved
+    bool blocks_dirty;
+
+    // Selects the mesher used by createVBOdata() and generateVBO()
+    static std::atomic<bool> greedyMeshing;
 
     Chunk();
-    Chunk(int, int, OpenGLContext*);
+    // Meshes are uploaded into arena, which must outlive the Chunk
+    Chunk(int, int, OpenGLContext*, ChunkArena *arena);
+    ~Chunk();
     void createVBOdata();
-    void generateVBO(std::vector<ChunkVBOData>&, std::mutex&);
+    // Meshes on the calling thread and hands the result to the queue for
+    // upload, moving the Chunk to MESHED first
+    void generateVBO(ChunkUploadQueue&);
+    ChunkState getState() const;
+    void setState(ChunkState);
+    // Whether the blocks are loaded or generated, i.e. the Chunk is past
+    // REQUESTED. Safe to call from any thread.
+    bool hasBlocks() const;
+    // Whether this Chunk and all four of its neighbors have blocks, so the
+    // faces on its borders come out right
+    bool neighborsHaveBlocks() const;
+    // Whether a mesh is on the GPU. Stays true while a newer one is built.
+    bool hasGpuMesh() const;
+    // Fills the given ChunkVBOData with this Chunk's opaque and transparent
+    // geometry, remeshing only the dirty sections. Makes no OpenGL calls;
+    // bindBuffer() uploads the result.
+    void buildVBOdata(ChunkVBOData&);
     BlockType getBlockAt(unsigned int x, unsigned int y, unsigned int z) const;
     BlockType getBlockAt(int x, int y, int z) const;
     void setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t);
+    // Sets the blocks from yStart up to, but not including, yEnd in the
+    // column (x, z). Much faster than setBlockAt per block: one bounds
+    // check and lock, and whole words of the sections' storage at a time.
+    void fillColumn(int x, int z, int yStart, int yEnd, BlockType t);
+    // Sets count blocks of the column (x, z) from yStart up to types
+    void setColumn(int x, int z, int yStart, const BlockType *types, int count);
+    // Run-length encodes the blocks for saving to a region file. Each
+    // x-z column is encoded from y = 0 up as (BlockType, run length - 1)
+    // byte pairs, since terrain mostly changes along y.
+    std::vector<unsigned char> encodeBlocks() const;
+    // Returns false and leaves the blocks unchanged if data is not valid
+    bool decodeBlocks(const std::vector<unsigned char> &data);
+    // Shrinks every section's palette to the types it still uses;
+    // call once a Chunk has been filled block by block
+    void compactBlocks();
+    // One above the highest non-EMPTY block of column (x, z), 0 if it is
+    // all EMPTY. Everything from there up is EMPTY.
+    int columnHeight(int x, int z) const;
+    // Lowest and highest y holding a non-EMPTY block; minBlockY() >
+    // maxBlockY() if the Chunk is all EMPTY
+    int minBlockY() const;
+    int maxBlockY() const;
+    // Non-EMPTY and WATER blocks in section s
+    int sectionBlockCount(int s) const;
+    int sectionTransparentCount(int s) const;
+    // Resident size of the block data in bytes
+    size_t blockBytes() const;
     void linkNeighbor(uPtr<Chunk>& neighbor, Direction dir);
-    std::vector<glm::vec4> findFace(glm::ivec3);
-    glm::vec3 findColor(BlockType);
-    std::vector<glm::vec4> findUV(BlockType, glm::ivec3);
-    bool checkBound(int, int, int);
-    bool checkNeighbor(int, int, int, BlockType);
-    bool checkConidtions(int, int, int, const glm::ivec3&, BlockType);
-    void bindBuffer(const std::vector<glm::vec4>&, const std::vector<glm::vec4>&,
-                    const std::vector<GLuint>&, const std::vector<GLuint>&);
+    // Clears the pointers between this Chunk and its neighbors, in both
+    // directions, so it can be deleted
+    void unlinkNeighbors();
+    // Indexed by Direction; nullptr where there is no neighbor
+    const std::array<Chunk*, 6>& getNeighbors() const;
+    // Frees the mesh's space in the arena and marks the Chunk as needing a
+    // new mesh. Leaves the state to the caller.
+    void releaseVBOdata();
+    // Makes the next mesh rebuild every section, e.g. after switching
+    // greedyMeshing
+    void invalidateMesh();
+    // Makes the next mesh rebuild section s for every bit s set
+    void markSectionsDirty(uint16_t sections);
+    bool hasDirtySections() const;
+    // Bytes held by the section meshes kept in RAM
+    size_t meshBytes() const;
+    // First index and index count of a section in the opaque or
+    // transparent index buffer
+    std::pair<GLuint, GLuint> sectionIndexRange(int section, bool transparent) const;
+    // Arena page of the uploaded mesh, or -1 if it has none
+    int arenaPage() const;
+    // Vertex in the arena page where the opaque or transparent quads start;
+    // the quad index buffer's indices are relative to it
+    GLint arenaBaseVertex(bool transparent) const;
+    // Uploads a mesh built by buildVBOdata, unless a newer one is already bound
+    void bindBuffer(const ChunkVBOData&);
+    // World-space box around the uploaded mesh: the Chunk's full width,
+    // but only as tall as the mesh's vertices reach
+    AABB getBounds() const;
+    // The section's connectivity as of the uploaded mesh; every face
+    // connects to every other until a mesh is uploaded
+    SectionConnectivity getSectionConnectivity(int section) const;
     glm::vec2 getMins();
 };
 
 struct ChunkVBOData {
     Chunk* chunk;
-    std::vector<glm::vec4> d;
-    std::vector<glm::vec4> d_trans;
-    std::vector<GLuint> idx;
-    std::vector<GLuint> idx_trans;
+    uint64_t version;
+    std::vector<ChunkVertex> d;
+    std::vector<ChunkVertex> d_trans;
+    // Where each section starts in the quad index buffer, 6 indices per
+    // quad, when the opaque or transparent vertices are drawn from it
+    std::array<GLuint, CHUNK_SECTIONS + 1> sectionIdx;
+    std::array<GLuint, CHUNK_SECTIONS + 1> sectionIdxTrans;
+    // Lowest and highest vertex y; minY > maxY if there are no vertices
+    int minY, maxY;
+    std::array<SectionConnectivity, CHUNK_SECTIONS> connectivity;
 };
@@ -0,0 +1,160 @@
+#include "chunkarena.h"
+#include "chunk.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+ChunkArena::ChunkArena(OpenGLContext *context)
+    : mp_context(context), m_pages(), m_usedQuads(0)
+{}
+
+ChunkArena::~ChunkArena()
+{}
+
+size_t ChunkArena::bytesPerQuad() {
+    return 4 * sizeof(ChunkVertex);
+}
+
+int ChunkArena::addPage(GLuint quads) {
+    uPtr<Page> page = mkU<Page>();
+    page->quads = quads;
+    page->freeRanges[0] = quads;
+    // Sub-ranges are rewritten as Chunks are remeshed, so the buffers are
+    // allocated once and filled with glBufferSubData
+    mp_context->glGenBuffers(1, &page->vertexBuffer);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, page->vertexBuffer);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, size_t(quads) * bytesPerQuad(), nullptr, GL_DYNAMIC_DRAW);
+    auto slot = std::find(m_pages.begin(), m_pages.end(), nullptr);
+    if (slot != m_pages.end()) {
+        *slot = std::move(page);
+        return slot - m_pages.begin();
+    }
+    m_pages.push_back(std::move(page));
+    return m_pages.size() - 1;
+}
+
+ChunkArena::Allocation ChunkArena::allocate(GLuint quads) {
+    Allocation a;
+    if (quads == 0) {
+        return a;
+    }
+    // First fit, so the front of each page fills up and the free ranges
+    // at the back stay large
+    for (size_t p = 0; p < m_pages.size() && a.page < 0; p++) {
+        if (m_pages[p] == nullptr) {
+            continue;
+        }
+        std::map<GLuint, GLuint> &free = m_pages[p]->freeRanges;
+        for (auto it = free.begin(); it != free.end(); ++it) {
+            if (it->second >= quads) {
+                a = Allocation{static_cast<int>(p), it->first, quads};
+                if (it->second > quads) {
+                    free[it->first + quads] = it->second - quads;
+                }
+                free.erase(it);
+                break;
+            }
+        }
+    }
+    if (a.page < 0) {
+        int p = addPage(std::max<GLuint>(CHUNK_ARENA_PAGE_QUADS, quads));
+        Page &page = *m_pages[p];
+        a = Allocation{p, 0, quads};
+        page.freeRanges.clear();
+        if (page.quads > quads) {
+            page.freeRanges[quads] = page.quads - quads;
+        }
+    }
+    m_usedQuads += quads;
+    return a;
+}
+
+void ChunkArena::release(Allocation &a) {
+    if (a.page < 0) {
+        return;
+    }
+    std::map<GLuint, GLuint> &free = m_pages[a.page]->freeRanges;
+    GLuint first = a.firstQuad, count = a.quadCount;
+    // Merge with the free ranges on either side
+    auto next = free.lower_bound(first);
+    if (next != free.end() && next->first == first + count) {
+        count += next->second;
+        next = free.erase(next);
+    }
+    if (next != free.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == first) {
+            first = prev->first;
+            count += prev->second;
+            free.erase(prev);
+        }
+    }
+    free[first] = count;
+    m_usedQuads -= a.quadCount;
+    a = Allocation();
+}
+
+void ChunkArena::upload(const Allocation &a, GLuint quadOffset, GLuint count, const ChunkVertex *vertices) {
+    if (count == 0) {
+        return;
+    }
+    if (a.page < 0 || quadOffset + count > a.quadCount) {
+        throw std::out_of_range("Upload of " + std::to_string(count) + " quads at " +
+                                std::to_string(quadOffset) + " overruns an allocation of " +
+                                std::to_string(a.quadCount));
+    }
+    const Page &page = *m_pages[a.page];
+    GLuint quad = a.firstQuad + quadOffset;
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, page.vertexBuffer);
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, size_t(quad) * bytesPerQuad(),
+                                size_t(count) * bytesPerQuad(), vertices);
+}
+
+void ChunkArena::trim() {
+    for (uPtr<Page> &page : m_pages) {
+        if (page == nullptr || page->freeRanges.size() != 1 ||
+            page->freeRanges.begin()->second != page->quads) {
+            continue;
+        }
+        mp_context->glDeleteBuffers(1, &page->vertexBuffer);
+        page = nullptr;
+    }
+    while (!m_pages.empty() && m_pages.back() == nullptr) {
+        m_pages.pop_back();
+    }
+}
+
+int ChunkArena::pageCount() const {
+    return m_pages.size();
+}
+
+GLuint ChunkArena::vertexBuffer(int page) const {
+    return m_pages[page] != nullptr ? m_pages[page]->vertexBuffer : 0;
+}
+
+size_t ChunkArena::capacityBytes() const {
+    size_t quads = 0;
+    for (const uPtr<Page> &page : m_pages) {
+        if (page != nullptr) {
+            quads += page->quads;
+        }
+    }
+    return quads * bytesPerQuad();
+}
+
+size_t ChunkArena::usedBytes() const {
+    return m_usedQuads * bytesPerQuad();
+}
+
+void ChunkArena::destroy() {
+    if (mp_context != nullptr) {
+        for (uPtr<Page> &page : m_pages) {
+            if (page != nullptr) {
+                mp_context->glDeleteBuffers(1, &page->vertexBuffer);
+            }
+        }
+    }
+    m_pages.clear();
+    m_usedQuads = 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "smartpointerhelp.h"
+#include "openglcontext.h"
+#include <map>
+#include <vector>
+
+struct ChunkVertex;
+
+// Quads a page holds unless a single mesh needs more: 32 MB of vertices
+#define CHUNK_ARENA_PAGE_QUADS (1 << 20)
+
+// Holds the meshes of every Chunk in a few large vertex buffers, so the
+// terrain can be drawn with one glMultiDrawElementsBaseVertex per buffer
+// instead of binding buffers for every Chunk.
+// Each page is a vertex buffer sub-allocated in whole quads, quad q being
+// vertices 4q to 4q + 3. Meshes are drawn with the context's shared quad
+// index buffer, offset to their vertices by the draw's base vertex.
+// Pages left empty are deleted by trim(). Allocations keep their page
+// numbers, so a deleted page leaves a slot without a buffer until a new
+// page takes it.
+// GUI thread only.
+class ChunkArena {
+public:
+    struct Allocation {
+        int page = -1; // -1 if nothing is allocated
+        GLuint firstQuad = 0;
+        GLuint quadCount = 0;
+    };
+
+    ChunkArena(OpenGLContext *context);
+    ~ChunkArena();
+
+    // Reserves room for quads quads, adding a page if none has a free
+    // range that large
+    Allocation allocate(GLuint quads);
+    // Returns the allocation's range to its page and resets it
+    void release(Allocation&);
+    // Writes the vertices of count quads at quad offset quadOffset of the
+    // allocation
+    void upload(const Allocation&, GLuint quadOffset, GLuint count, const ChunkVertex *vertices);
+
+    // Deletes the GPU buffers of pages nothing is allocated in. Done
+    // separately from release() so a Chunk remeshed alone on a page doesn't
+    // delete and recreate it.
+    void trim();
+
+    // Includes the slots of deleted pages
+    int pageCount() const;
+    // 0 for the slot of a deleted page
+    GLuint vertexBuffer(int page) const;
+    // Bytes of GPU memory the pages take, and how many of them are allocated
+    size_t capacityBytes() const;
+    size_t usedBytes() const;
+
+    // Frees the GPU buffers of every page. Every allocation must have been
+    // released first.
+    void destroy();
+
+private:
+    struct Page {
+        GLuint vertexBuffer;
+        GLuint quads;
+        // First quad to quad count of every free range, neighboring
+        // ranges merged
+        std::map<GLuint, GLuint> freeRanges;
+    };
+
+    OpenGLContext *mp_context;
+    // nullptr in the slots of deleted pages
+    std::vector<uPtr<Page>> m_pages;
+    size_t m_usedQuads;
+
+    static size_t bytesPerQuad();
+    // Returns the new page's number
+    int addPage(GLuint quads);
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include "glm_includes.h"
+#include <cstdint>
+
+// Helper functions to convert (x, z) to and from hash map key.
+// Shared by Terrain and the region files, so storage needn't see the rest
+// of the Terrain.
+
+// Combine two 32-bit ints into one 64-bit int
+// where the upper 32 bits are X and the lower 32 bits are Z
+inline int64_t toKey(int x, int z) {
+    int64_t xz = 0xffffffffffffffff;
+    int64_t x64 = x;
+    int64_t z64 = z;
+
+    // Set all lower 32 bits to 1 so we can & with Z later
+    xz = (xz & (x64 << 32)) | 0x00000000ffffffff;
+
+    // Set all upper 32 bits to 1 so we can & with XZ
+    z64 = z64 | 0xffffffff00000000;
+
+    // Combine
+    xz = xz & z64;
+    return xz;
+}
+
+inline glm::ivec2 toCoords(int64_t k) {
+    // Z is lower 32 bits
+    int64_t z = k & 0x00000000ffffffff;
+    // If the most significant bit of Z is 1, then it's a negative number
+    // so we have to set all the upper 32 bits to 1.
+    // Note the 8    V
+    if(z & 0x0000000080000000) {
+        z = z | 0xffffffff00000000;
+    }
+    int64_t x = (k >> 32);
+
+    return glm::ivec2(x, z);
+}
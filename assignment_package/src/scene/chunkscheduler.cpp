@@ -0,0 +1,153 @@
+#include "chunkscheduler.h"
+#include "chunk.h"
+#include "profiler.h"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+ChunkScheduler::ChunkScheduler(JobSystem &jobs)
+    : mr_jobs(jobs), m_pending(), m_scheduled(), m_inFlight(0),
+      // Enough to keep every worker busy while the next job is queued,
+      // few enough that the ranking is still fresh when a job starts
+      m_maxInFlight(2 * jobs.workerCount()), m_cancelled(0),
+      m_doneMutex(), m_done(),
+      m_waiting(false), m_waitStart(), m_lastTimeToVisible(-1.f)
+{}
+
+void ChunkScheduler::request(Chunk *c, TaskType type, std::function<void()> work,
+                             std::function<void()> onCancel) {
+    if (!m_scheduled[type].insert(c).second) {
+        return;
+    }
+    glm::vec2 mins = c->getMins();
+    m_pending.push_back(Task{c, type, glm::ivec2(mins), 0.f,
+                             std::move(work), std::move(onCancel)});
+}
+
+bool ChunkScheduler::isScheduled(const Chunk *c, TaskType type) const {
+    return m_scheduled[type].find(c) != m_scheduled[type].end();
+}
+
+float ChunkScheduler::computeCost(const Task &t, glm::vec2 pos, glm::vec2 forward) {
+    glm::vec2 toChunk = glm::vec2(t.mins) + glm::vec2(8.f) - pos;
+    float dist = glm::length(toChunk);
+    // The chunks right around the player are visible whichever way the
+    // camera faces, so don't push them back for being behind it
+    float facing = dist > 16.f ? glm::dot(toChunk / dist, forward) : 1.f;
+    return dist * (1.5f - 0.5f * facing);
+}
+
+bool ChunkScheduler::lowerPriority(const Task &a, const Task &b) {
+    if (a.cost != b.cost) {
+        return a.cost > b.cost;
+    }
+    // Meshing is the step that actually puts a chunk on screen
+    return a.type < b.type;
+}
+
+void ChunkScheduler::update(glm::vec3 pos, glm::vec3 forward, int radius) {
+    PROFILE_SCOPE("ChunkScheduler::update");
+    std::vector<Done> done;
+    {
+        std::lock_guard<std::mutex> lock(m_doneMutex);
+        std::swap(done, m_done);
+    }
+    for (Done &d : done) {
+        m_scheduled[d.type].erase(d.chunk);
+        m_inFlight--;
+        if (d.onFailure) {
+            d.onFailure();
+        }
+    }
+
+    glm::vec2 pos2(pos.x, pos.z);
+    // Looking straight up or down gives no useful heading; rank by distance alone
+    glm::vec2 forward2(forward.x, forward.z);
+    float len = glm::length(forward2);
+    forward2 = len > 0.001f ? forward2 / len : glm::vec2(0.f);
+
+    int xZone = static_cast<int>(glm::floor(pos.x / 64.f));
+    int zZone = static_cast<int>(glm::floor(pos.z / 64.f));
+    for (size_t i = 0; i < m_pending.size();) {
+        Task &t = m_pending[i];
+        int dx = static_cast<int>(glm::floor(t.mins.x / 64.f)) - xZone;
+        int dz = static_cast<int>(glm::floor(t.mins.y / 64.f)) - zZone;
+        if (std::abs(dx) > radius || std::abs(dz) > radius) {
+            if (t.onCancel) {
+                t.onCancel();
+            }
+            m_scheduled[t.type].erase(t.chunk);
+            m_cancelled++;
+            if (i + 1 < m_pending.size()) {
+                t = std::move(m_pending.back());
+            }
+            m_pending.pop_back();
+            continue;
+        }
+        t.cost = computeCost(t, pos2, forward2);
+        i++;
+    }
+
+    // The player moves every tick, so re-rank from scratch
+    std::make_heap(m_pending.begin(), m_pending.end(), lowerPriority);
+    while (m_inFlight < m_maxInFlight && !m_pending.empty()) {
+        std::pop_heap(m_pending.begin(), m_pending.end(), lowerPriority);
+        Task t = std::move(m_pending.back());
+        m_pending.pop_back();
+
+        m_inFlight++;
+        const Chunk *c = t.chunk;
+        TaskType type = t.type;
+        mr_jobs.submit([this, work = std::move(t.work), onCancel = std::move(t.onCancel), c, type]() {
+            // Retired however work() ends, or the task would count as in
+            // flight, and its chunk as scheduled, forever
+            struct Retire {
+                ChunkScheduler *scheduler;
+                Done done;
+                ~Retire() {
+                    std::lock_guard<std::mutex> lock(scheduler->m_doneMutex);
+                    scheduler->m_done.push_back(std::move(done));
+                }
+            } retire{this, Done{c, type, nullptr}};
+            try {
+                work();
+            } catch (const std::exception &e) {
+                // Nothing on a worker can handle it; undo the request like
+                // a cancellation so the chunk can be queued again
+                std::cerr << "Chunk task failed: " << e.what() << std::endl;
+                retire.done.onFailure = onCancel;
+            }
+        });
+    }
+}
+
+void ChunkScheduler::trackVisibility(bool visible) {
+    auto now = std::chrono::steady_clock::now();
+    if (!visible && !m_waiting) {
+        m_waiting = true;
+        m_waitStart = now;
+    } else if (visible && m_waiting) {
+        m_waiting = false;
+        m_lastTimeToVisible = std::chrono::duration<float, std::milli>(now - m_waitStart).count();
+    }
+}
+
+float ChunkScheduler::lastTimeToVisible() const {
+    return m_lastTimeToVisible;
+}
+
+bool ChunkScheduler::isWaitingForTerrain() const {
+    return m_waiting;
+}
+
+size_t ChunkScheduler::pendingCount() const {
+    return m_pending.size();
+}
+
+size_t ChunkScheduler::inFlightCount() const {
+    return m_inFlight;
+}
+
+size_t ChunkScheduler::cancelledCount() const {
+    return m_cancelled;
+}
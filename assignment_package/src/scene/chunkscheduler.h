@@ -0,0 +1,93 @@
+#pragma once
+#include "glm_includes.h"
+#include "jobsystem.h"
+#include <array>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+class Chunk;
+
+// Decides which chunk jobs the JobSystem runs next.
+// Terrain queues block generation and meshing here instead of submitting
+// them straight to the workers. Every tick the pending jobs are ranked by
+// their distance to the player, with chunks in front of the camera ranked
+// ahead of chunks behind it, and only a handful are handed to the workers
+// at a time so the queue can still be reordered as the player moves.
+// Jobs whose chunk leaves the load radius before they start are cancelled.
+class ChunkScheduler {
+public:
+    enum TaskType : unsigned char {
+        GENERATE, MESH
+    };
+
+    ChunkScheduler(JobSystem &jobs);
+
+    // Queues work for the chunk unless a task of the same type is already
+    // pending or running for it. onCancel runs on the GUI thread if the
+    // task is dropped before it starts, or if work throws.
+    void request(Chunk *c, TaskType type, std::function<void()> work,
+                 std::function<void()> onCancel = nullptr);
+    // Is a task of this type pending or running for the chunk?
+    bool isScheduled(const Chunk *c, TaskType type) const;
+
+    // Called once per tick from the GUI thread. Retires finished tasks,
+    // cancels pending tasks for chunks more than radius terrain zones away
+    // from pos, then dispatches the best ranked tasks to the workers.
+    void update(glm::vec3 pos, glm::vec3 forward, int radius);
+
+    // Time-to-first-visible-terrain. Call once per tick with whether the
+    // terrain under the player has a mesh on the GPU; the time between it
+    // going missing (after a teleport, or flying faster than chunks load)
+    // and coming back is recorded.
+    void trackVisibility(bool visible);
+    // Milliseconds the last wait for terrain took, or -1 if there was none yet
+    float lastTimeToVisible() const;
+    bool isWaitingForTerrain() const;
+
+    size_t pendingCount() const;
+    size_t inFlightCount() const;
+    // Total number of tasks cancelled since startup
+    size_t cancelledCount() const;
+
+private:
+    struct Task {
+        Chunk *chunk;
+        TaskType type;
+        glm::ivec2 mins;
+        float cost;
+        std::function<void()> work;
+        std::function<void()> onCancel;
+    };
+
+    JobSystem &mr_jobs;
+    // Kept as a heap ordered by Task::cost, rebuilt every update()
+    std::vector<Task> m_pending;
+    // Chunks with a pending or running task, one set per TaskType
+    std::array<std::unordered_set<const Chunk*>, 2> m_scheduled;
+    size_t m_inFlight;
+    size_t m_maxInFlight;
+    size_t m_cancelled;
+
+    // Tasks finished by the workers, retired on the GUI thread in update().
+    // onFailure is the task's onCancel if its work threw.
+    struct Done {
+        const Chunk *chunk;
+        TaskType type;
+        std::function<void()> onFailure;
+    };
+    std::mutex m_doneMutex;
+    std::vector<Done> m_done;
+
+    bool m_waiting;
+    std::chrono::steady_clock::time_point m_waitStart;
+    float m_lastTimeToVisible;
+
+    // Distance from pos to the chunk's center, stretched by up to 2x
+    // the further the chunk is from the camera's forward direction
+    static float computeCost(const Task &t, glm::vec2 pos, glm::vec2 forward);
+    // Heap order: the cheapest task ends up on top, meshing wins ties
+    static bool lowerPriority(const Task &a, const Task &b);
+};
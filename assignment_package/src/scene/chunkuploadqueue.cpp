@@ -0,0 +1,87 @@
+#include "chunkuploadqueue.h"
+#include "profiler.h"
+#include <algorithm>
+
+ChunkUploadQueue::ChunkUploadQueue(size_t maxBytes, size_t maxChunks)
+    : m_mutex(), m_incoming(), m_waiting(),
+      m_maxBytes(maxBytes), m_maxChunks(maxChunks),
+      m_bytesLastFrame(0), m_chunksLastFrame(0)
+{}
+
+size_t ChunkUploadQueue::byteSize(const ChunkVBOData &v) {
+    return (v.d.size() + v.d_trans.size()) * sizeof(ChunkVertex);
+}
+
+void ChunkUploadQueue::push(ChunkVBOData &&data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_incoming.push_back(std::move(data));
+}
+
+void ChunkUploadQueue::upload(glm::vec3 pos) {
+    PROFILE_SCOPE("ChunkUploadQueue::upload");
+    {
+        // Hold the lock only long enough to take what the workers finished
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (ChunkVBOData &v : m_incoming) {
+            Chunk *c = v.chunk;
+            m_waiting[c] = std::move(v);
+        }
+        m_incoming.clear();
+    }
+
+    m_bytesLastFrame = 0;
+    m_chunksLastFrame = 0;
+    if (m_waiting.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<float, Chunk*>> order;
+    order.reserve(m_waiting.size());
+    glm::vec2 pos2(pos.x, pos.z);
+    for (auto &[c, v] : m_waiting) {
+        glm::vec2 center = c->getMins() + glm::vec2(8.f);
+        glm::vec2 diff = center - pos2;
+        order.emplace_back(glm::dot(diff, diff), c);
+    }
+    // Only the front of the list can fit in this frame's budget
+    size_t n = std::min(order.size(), std::max<size_t>(m_maxChunks, 1));
+    std::partial_sort(order.begin(), order.begin() + n, order.end());
+
+    for (size_t i = 0; i < n; i++) {
+        auto it = m_waiting.find(order[i].second);
+        size_t bytes = byteSize(it->second);
+        if (m_chunksLastFrame > 0 && m_bytesLastFrame + bytes > m_maxBytes) {
+            break;
+        }
+        const ChunkVBOData &v = it->second;
+        v.chunk->bindBuffer(v);
+        m_bytesLastFrame += bytes;
+        m_chunksLastFrame++;
+        m_waiting.erase(it);
+    }
+}
+
+void ChunkUploadQueue::discard(Chunk *c) {
+    m_waiting.erase(c);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_incoming.erase(std::remove_if(m_incoming.begin(), m_incoming.end(),
+                                    [c](const ChunkVBOData &v) { return v.chunk == c; }),
+                     m_incoming.end());
+}
+
+void ChunkUploadQueue::setBudget(size_t maxBytes, size_t maxChunks) {
+    m_maxBytes = maxBytes;
+    m_maxChunks = maxChunks;
+}
+
+size_t ChunkUploadQueue::depth() const {
+    return m_waiting.size();
+}
+
+size_t ChunkUploadQueue::bytesLastFrame() const {
+    return m_bytesLastFrame;
+}
+
+size_t ChunkUploadQueue::chunksLastFrame() const {
+    return m_chunksLastFrame;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "glm_includes.h"
+#include "chunk.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Default per-frame upload budget
+#define UPLOAD_BYTES_PER_FRAME (2 << 20)
+#define UPLOAD_CHUNKS_PER_FRAME 8
+
+// Meshes finished by the workers wait here until the GUI thread sends
+// them to the GPU. Every frame the meshes nearest the player go first, and
+// uploading stops once the byte or chunk budget is spent, so a whole ring
+// of zones finishing together streams in over several frames instead of
+// stalling one of them.
+class ChunkUploadQueue {
+private:
+    // Pushed by the workers, guarded by m_mutex
+    std::mutex m_mutex;
+    std::vector<ChunkVBOData> m_incoming;
+    // GUI thread only. Keyed by Chunk so a remesh replaces a mesh that
+    // never made it to the GPU instead of being uploaded after it.
+    std::unordered_map<Chunk*, ChunkVBOData> m_waiting;
+
+    size_t m_maxBytes;
+    size_t m_maxChunks;
+    size_t m_bytesLastFrame;
+    size_t m_chunksLastFrame;
+
+    static size_t byteSize(const ChunkVBOData&);
+
+public:
+    ChunkUploadQueue(size_t maxBytes = UPLOAD_BYTES_PER_FRAME,
+                     size_t maxChunks = UPLOAD_CHUNKS_PER_FRAME);
+
+    // Safe to call from any thread
+    void push(ChunkVBOData &&data);
+    // Uploads the waiting meshes nearest to pos until either budget runs
+    // out. At least one mesh goes up every frame, however large it is.
+    // GUI thread only.
+    void upload(glm::vec3 pos);
+    // Drops any mesh still waiting for this Chunk, e.g. because it is
+    // about to be deleted. GUI thread only.
+    void discard(Chunk *c);
+
+    void setBudget(size_t maxBytes, size_t maxChunks);
+
+    // Meshes still waiting after the last upload()
+    size_t depth() const;
+    size_t bytesLastFrame() const;
+    size_t chunksLastFrame() const;
+};
@@ -116,42 +116,20 @@ void createCubeVertexNormals(glm::vec4 (&cub_vert_nor)[CUB_VERT_COUNT])
     }
 }
 
-void createCubeIndices(GLuint (&cub_idx)[CUB_IDX_COUNT])
-{
-    int idx = 0;
-    for(int i = 0; i < 6; i++){
-        cub_idx[idx++] = i*4;
-        cub_idx[idx++] = i*4+1;
-        cub_idx[idx++] = i*4+2;
-        cub_idx[idx++] = i*4;
-        cub_idx[idx++] = i*4+2;
-        cub_idx[idx++] = i*4+3;
-    }
-}
-
 void Cube::createVBOdata()
 {
-    GLuint sph_idx[CUB_IDX_COUNT];
     glm::vec4 sph_vert_pos[CUB_VERT_COUNT];
     glm::vec4 sph_vert_nor[CUB_VERT_COUNT];
 
     createCubeVertexPositions(sph_vert_pos);
     createCubeVertexNormals(sph_vert_nor);
-    createCubeIndices(sph_idx);
 
     m_count = CUB_IDX_COUNT;
+    // The six faces are quads of four vertices each, so their triangles
+    // come from the shared quad index buffer
+    useQuadIndices();
 
-    // Create a VBO on our GPU and store its handle in bufIdx
-    generateIdx();
-    // Tell OpenGL that we want to perform subsequent operations on the VBO referred to by bufIdx
-    // and that it will be treated as an element array buffer (since it will contain triangle indices)
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    // Pass the data stored in cyl_idx into the bound buffer, reading a number of bytes equal to
-    // SPH_IDX_COUNT multiplied by the size of a GLuint. This data is sent to the GPU to be read by shader programs.
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, CUB_IDX_COUNT * sizeof(GLuint), sph_idx, GL_STATIC_DRAW);
-
-    // The next few sets of function calls are basically the same as above, except bufPos and bufNor are
-    // array buffers rather than element array buffers, as they store vertex attributes like position.
+    // Vertex attributes like position go in array buffers
     generatePos();
     mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
     mp_context->glBufferData(GL_ARRAY_BUFFER, CUB_VERT_COUNT * sizeof(glm::vec4), sph_vert_pos, GL_STATIC_DRAW);
@@ -0,0 +1,33 @@
+#include "frustum.h"
+
+Frustum::Frustum(const glm::mat4 &viewProj)
+    : m_planes()
+{
+    // A point is in clip space if -w <= x, y, z <= w. With row i of the
+    // matrix as r_i, that is r_3 + r_i >= 0 and r_3 - r_i >= 0 for world
+    // space points. glm matrices are indexed [column][row].
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        m_planes[2 * i] = rows[3] + rows[i];
+        m_planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4 &p : m_planes) {
+        p /= glm::length(glm::vec3(p));
+    }
+}
+
+bool Frustum::intersects(const AABB &box) const {
+    for (const glm::vec4 &p : m_planes) {
+        // The box's corner furthest along the plane's normal
+        glm::vec3 corner(p.x >= 0.f ? box.max.x : box.min.x,
+                         p.y >= 0.f ? box.max.y : box.min.y,
+                         p.z >= 0.f ? box.max.z : box.min.z);
+        if (glm::dot(glm::vec3(p), corner) + p.w < 0.f) {
+            return false;
+        }
+    }
+    return true;
+}
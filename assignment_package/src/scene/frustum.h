@@ -0,0 +1,26 @@
+#pragma once
+#include "glm_includes.h"
+#include <array>
+
+// An axis-aligned box in world space
+struct AABB {
+    glm::vec3 min, max;
+};
+
+// The six planes bounding what a camera sees, pointing inwards
+class Frustum {
+public:
+    // Extracts the planes from a combined projection and view matrix, e.g.
+    // Camera::getViewProj(), so they are in world space
+    explicit Frustum(const glm::mat4 &viewProj);
+
+    // False only if the box is entirely outside one of the planes. Boxes
+    // near the frustum's corners can pass without being visible, which
+    // only costs a draw call.
+    bool intersects(const AABB &box) const;
+
+private:
+    // xyz is the plane's normal and w its offset: p is inside if
+    // dot(xyz, p) + w >= 0
+    std::array<glm::vec4, 6> m_planes;
+};
@@ -0,0 +1,389 @@
+#include "noise.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+
+float random1( glm::vec2 p ) {
+    return glm::fract(glm::sin(glm::dot(p,glm::vec2(127.1,311.7)))*43758.5453f);
+}
+
+float mySmootherStep(float a, float b, float t) {
+    t = t*t*t*(t*(t*6.0 - 15.0) + 10.0);
+    return glm::mix(a, b, t);
+}
+
+float bilerpNoise(glm::vec2 uv) {
+    glm::vec2 uvFract = glm::fract(uv);
+    float ll = random1(glm::floor(uv));
+    float lr = random1(glm::floor(uv) + glm::vec2(1,0));
+    float ul = random1(glm::floor(uv) + glm::vec2(0,1));
+    float ur = random1(glm::floor(uv) + glm::vec2(1,1));
+
+    float lerpXL = mySmootherStep(ll, lr, uvFract.x);
+    float lerpXU = mySmootherStep(ul, ur, uvFract.x);
+
+    return mySmootherStep(lerpXL, lerpXU, uvFract.y);
+}
+
+float fbm(glm::vec2 uv) {
+    float amp = 0.5;
+    float freq = 8.0;
+    float sum = 0.0;
+    for(int i = 0; i < 6; i++) {
+        sum += bilerpNoise(uv * freq) * amp;
+        amp *= 0.5;
+        freq *= 2.0;
+    }
+    return sum;
+}
+
+glm::vec2 random2( glm::vec2 p ) {
+    return glm::fract(glm::sin(glm::vec2(glm::dot(p,glm::vec2(127.1,311.7)),glm::dot(p,glm::vec2(269.5,183.3))))*43758.5453f);
+}
+
+float surflet(glm::vec2 P, glm::vec2 gridPoint) {
+    // Compute falloff function by converting linear distance to a polynomial (quintic smootherstep function)
+    float distX = std::abs(P.x - gridPoint.x);
+    float distY = std::abs(P.y - gridPoint.y);
+    float tX = 1.0 - 6.0 * std::pow(distX, 5.0) + 15.0 * std::pow(distX, 4.0) - 10.0 * std::pow(distX, 3.0);
+    float tY = 1.0 - 6.0 * std::pow(distY, 5.0) + 15.0 * std::pow(distY, 4.0) - 10.0 * std::pow(distY, 3.0);
+
+    // Get the random vector for the grid point
+    glm::vec2 gradient = random2(gridPoint);
+    // Get the vector from the grid point to P
+    glm::vec2 diff = P - gridPoint;
+    // Get the value of our height field by dotting grid->P with our gradient
+    float height = glm::dot(diff, gradient);
+    // Scale our height field (i.e. reduce it) by our polynomial falloff function
+    return height * tX * tY;
+}
+
+float PerlinNoise(glm::vec2 uv) {
+    // Tile the space
+    glm::vec2 uvXLYL = glm::floor(uv);
+    glm::vec2 uvXHYL = uvXLYL + glm::vec2(1,0);
+    glm::vec2 uvXHYH = uvXLYL + glm::vec2(1,1);
+    glm::vec2 uvXLYH = uvXLYL + glm::vec2(0,1);
+
+    return surflet(uv, uvXLYL) + surflet(uv, uvXHYL) + surflet(uv, uvXHYH) + surflet(uv, uvXLYH);
+}
+
+
+float fractalNoise(glm::vec2 uv, float o, float l, float p, float s) {
+    float value = 0.;
+    float amp = 2;
+    float x1 = uv.x;
+    float z1 = uv.y;
+    for (int i = 0; i < o; i++) {
+        value += std::abs(PerlinNoise(glm::vec2(x1, z1) / s)) * amp;
+        x1 *= l;
+        z1 *= l;
+        amp *= p;
+    }
+    value = std::pow(value, 2);
+    return glm::clamp(value, -1.f, 1.f);
+}
+
+float WorleyNoise(glm::vec2 uv) {
+
+    // Tile the space
+    glm::vec2 uvInt = glm::floor(uv);
+    glm::vec2 uvFract = glm::fract(uv);
+    float minDist = 1.0; // Minimum distance initialized to max.
+
+    // Search all neighboring cells and this cell for their point
+    for(int y = -1; y <= 1; y++) {
+        for(int x = -1; x <= 1; x++) {
+            glm::vec2 neighbor = glm::vec2(float(x), float(y));
+
+            // Random point inside current neighboring cell
+            glm::vec2 point = random2(uvInt + neighbor);
+
+            // Animate the point
+//            point = 0.5 + 0.5 * sin(u_Time * 0.01 + 6.2831 * point); // 0 to 1 range
+
+            // Compute the distance b/t the point and the fragment
+            // Store the min dist thus far
+            glm::vec2 diff = neighbor + point - uvFract;
+            float dist = glm::length(diff);
+            minDist = glm::min(minDist, dist);
+        }
+    }
+    return minDist;
+}
+
+void computeHeightmapReference(int minX, int minZ, ChunkHeightmap &out) {
+    for(int x = 0; x < 16; x++) {
+        for(int z = 0; z < 16; z++) {
+            glm::vec2 xz = glm::vec2(float(minX + x), float(minZ + z));
+            float mountain = glm::floor((150.f + glm::abs(fractalNoise(xz, 5, 3, 0.2, 80)) * 200));
+            glm::vec2 offset = glm::vec2(fbm(xz / 256.f), fbm(xz / 128.f)) + glm::vec2(1000.f);
+            float grass =  128 + (1. - WorleyNoise((xz + offset * 50.f) / 70.f)) * 30.f;
+            float lerp =  0.5 * (PerlinNoise(xz / 200.f) + 1.f);
+            lerp = glm::smoothstep(0.4, 0.6, (double)lerp);
+            float y_final = glm::mix(grass, mountain, lerp);
+            out.height[x + 16 * z] = glm::min(y_final, 255.f);
+            out.mountain[x + 16 * z] = mountain;
+            out.biome[x + 16 * z] = lerp;
+        }
+    }
+}
+
+//////// The same functions for SIMD_LANES points at once ////////////
+// Each mirrors its reference function above operation by operation,
+// including where the reference mixes in double arithmetic.
+
+namespace {
+
+// The constants the reference converts from double
+const float HASH_X1 = static_cast<float>(127.1), HASH_Y1 = static_cast<float>(311.7);
+const float HASH_X2 = static_cast<float>(269.5), HASH_Y2 = static_cast<float>(183.3);
+
+// fract(sin(dot(p, k)) * 43758.5453)
+vfloat vHash(vfloat px, vfloat py, float kx, float ky) {
+    return fract(sin(px * vfloat(kx) + py * vfloat(ky)) * vfloat(43758.5453f));
+}
+
+// The random value in [0, 1) at the lattice points (u, v), one per
+// NoiseBackend. Stream 0 is random1(), and streams 0 and 1 are the two
+// components of random2().
+struct SinFractHash {
+    vfloat operator()(vfloat u, vfloat v, int stream) const {
+        return stream == 0 ? vHash(u, v, HASH_X1, HASH_Y1) : vHash(u, v, HASH_X2, HASH_Y2);
+    }
+};
+
+struct IntegerHash {
+    uint32_t seed;
+    vfloat operator()(vfloat u, vfloat v, int stream) const {
+        vuint h = hashLattice(toUint(u), toUint(v), vuint(seed), vuint(static_cast<uint32_t>(stream)));
+        // The top 24 bits, which a float holds exactly
+        return toFloat(h >> 8) * vfloat(1.f / 16777216.f);
+    }
+};
+
+vfloat vSmootherStep(vfloat a, vfloat b, vfloat t) {
+    vdouble td = toDouble(t);
+    t = toFloat(toDouble(t * t * t) * (td * (td * vdouble(6.0) - vdouble(15.0)) + vdouble(10.0)));
+    return a + t * (b - a);
+}
+
+template <typename Hash>
+vfloat vBilerpNoise(const Hash &hash, vfloat u, vfloat v) {
+    vfloat fu = floor(u), fv = floor(v);
+    vfloat ll = hash(fu, fv, 0);
+    vfloat lr = hash(fu + vfloat(1.f), fv, 0);
+    vfloat ul = hash(fu, fv + vfloat(1.f), 0);
+    vfloat ur = hash(fu + vfloat(1.f), fv + vfloat(1.f), 0);
+
+    vfloat lerpXL = vSmootherStep(ll, lr, u - fu);
+    vfloat lerpXU = vSmootherStep(ul, ur, u - fu);
+    return vSmootherStep(lerpXL, lerpXU, v - fv);
+}
+
+template <typename Hash>
+vfloat vFbm(const Hash &hash, vfloat u, vfloat v) {
+    float amp = 0.5f;
+    float freq = 8.f;
+    vfloat sum(0.f);
+    for (int i = 0; i < 6; i++) {
+        sum = sum + vBilerpNoise(hash, u * vfloat(freq), v * vfloat(freq)) * vfloat(amp);
+        amp *= 0.5f;
+        freq *= 2.f;
+    }
+    return sum;
+}
+
+// 1 - 6 d^5 + 15 d^4 - 10 d^3, in double like the reference's pow() calls
+vfloat vFalloff(vfloat d) {
+    vdouble d1 = toDouble(d);
+    vdouble d2 = d1 * d1;
+    vdouble d3 = d2 * d1;
+    vdouble d4 = d2 * d2;
+    vdouble d5 = d4 * d1;
+    return toFloat(vdouble(1.0) - vdouble(6.0) * d5 + vdouble(15.0) * d4 - vdouble(10.0) * d3);
+}
+
+template <typename Hash>
+vfloat vSurflet(const Hash &hash, vfloat pu, vfloat pv, vfloat gu, vfloat gv) {
+    vfloat tX = vFalloff(abs(pu - gu));
+    vfloat tY = vFalloff(abs(pv - gv));
+    vfloat gradU = hash(gu, gv, 0);
+    vfloat gradV = hash(gu, gv, 1);
+    vfloat height = (pu - gu) * gradU + (pv - gv) * gradV;
+    return height * tX * tY;
+}
+
+template <typename Hash>
+vfloat vPerlinNoise(const Hash &hash, vfloat u, vfloat v) {
+    vfloat gu = floor(u), gv = floor(v);
+    vfloat gu1 = gu + vfloat(1.f), gv1 = gv + vfloat(1.f);
+    return vSurflet(hash, u, v, gu, gv) + vSurflet(hash, u, v, gu1, gv) +
+           vSurflet(hash, u, v, gu1, gv1) + vSurflet(hash, u, v, gu, gv1);
+}
+
+// fractalNoise(uv, 5, 3, 0.2, 80), the only parameters generation uses
+template <typename Hash>
+vfloat vFractalNoise(const Hash &hash, vfloat u, vfloat v) {
+    const float lacunarity = 3.f, persistence = static_cast<float>(0.2), scale = 80.f;
+    vfloat value(0.f);
+    float amp = 2.f;
+    for (int i = 0; i < 5; i++) {
+        value = value + abs(vPerlinNoise(hash, u / vfloat(scale), v / vfloat(scale))) * vfloat(amp);
+        u = u * vfloat(lacunarity);
+        v = v * vfloat(lacunarity);
+        amp *= persistence;
+    }
+    // The square is never negative, so clamping only caps it at 1
+    return min(value * value, vfloat(1.f));
+}
+
+template <typename Hash>
+vfloat vWorleyNoise(const Hash &hash, vfloat u, vfloat v) {
+    vfloat iu = floor(u), iv = floor(v);
+    vfloat fu = u - iu, fv = v - iv;
+    vfloat minDist(1.f);
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vfloat nu = vfloat(static_cast<float>(x)), nv = vfloat(static_cast<float>(y));
+            vfloat cellU = iu + nu, cellV = iv + nv;
+            vfloat du = nu + hash(cellU, cellV, 0) - fu;
+            vfloat dv = nv + hash(cellU, cellV, 1) - fv;
+            minDist = min(minDist, sqrt(du * du + dv * dv));
+        }
+    }
+    return minDist;
+}
+
+// The low-frequency fields of the columns (x, z): the fbm() values that
+// warp the Worley noise, and the biome blend
+template <typename Hash>
+void vLowFrequency(const Hash &hash, vfloat x, vfloat z, vfloat &warpX, vfloat &warpZ, vfloat &biome) {
+    warpX = vFbm(hash, x / vfloat(256.f), z / vfloat(256.f));
+    warpZ = vFbm(hash, x / vfloat(128.f), z / vfloat(128.f));
+    // Halving is exact, so it doesn't matter that the reference does it in double
+    vfloat lerp = (vPerlinNoise(hash, x / vfloat(200.f), z / vfloat(200.f)) + vfloat(1.f)) * vfloat(0.5f);
+    // glm::smoothstep(0.4, 0.6, lerp), in double like the reference
+    vdouble t = min(max((toDouble(lerp) - vdouble(0.4)) / vdouble(0.6 - 0.4), vdouble(0.0)), vdouble(1.0));
+    biome = toFloat(t * t * (vdouble(3.0) - vdouble(2.0) * t));
+}
+
+// The surface height of the columns (x, z), given their low-frequency fields
+template <typename Hash>
+vfloat vSurface(const Hash &hash, vfloat x, vfloat z, vfloat warpX, vfloat warpZ, vfloat biome,
+                vfloat &mountain) {
+    mountain = floor(vfloat(150.f) + abs(vFractalNoise(hash, x, z)) * vfloat(200.f));
+    vfloat offsetX = warpX + vfloat(1000.f);
+    vfloat offsetZ = warpZ + vfloat(1000.f);
+    vfloat worley = vWorleyNoise(hash, (x + offsetX * vfloat(50.f)) / vfloat(70.f),
+                                       (z + offsetZ * vfloat(50.f)) / vfloat(70.f));
+    vfloat grass = toFloat(vdouble(128.0) + (vdouble(1.0) - toDouble(worley)) * vdouble(30.0));
+    return min(grass + biome * (mountain - grass), vfloat(255.f));
+}
+
+template <typename Hash>
+void fillHeightmap(const Hash &hash, int minX, int minZ, ChunkHeightmap &out) {
+    for (int z = 0; z < 16; z++) {
+        for (int x0 = 0; x0 < 16; x0 += SIMD_LANES) {
+            vfloat x = vfloat(float(minX + x0)) + laneIndex();
+            vfloat zs(float(minZ + z));
+            vfloat warpX, warpZ, biome, mountain;
+            vLowFrequency(hash, x, zs, warpX, warpZ, biome);
+            vfloat height = vSurface(hash, x, zs, warpX, warpZ, biome, mountain);
+
+            int i = x0 + 16 * z;
+            height.store(&out.height[i]);
+            mountain.store(&out.mountain[i]);
+            biome.store(&out.biome[i]);
+        }
+    }
+}
+
+// The same, with the low-frequency fields interpolated from the zone's
+template <typename Hash>
+void fillHeightmap(const Hash &hash, int minX, int minZ, const HeightField &field, ChunkHeightmap &out) {
+    ChunkHeightmap warp; // height holds warpX and mountain warpZ
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            int i = x + 16 * z;
+            warp.height[i] = field.sample(field.warpX, minX + x, minZ + z);
+            warp.mountain[i] = field.sample(field.warpZ, minX + x, minZ + z);
+            out.biome[i] = field.sample(field.biome, minX + x, minZ + z);
+        }
+    }
+    for (int z = 0; z < 16; z++) {
+        for (int x0 = 0; x0 < 16; x0 += SIMD_LANES) {
+            int i = x0 + 16 * z;
+            vfloat x = vfloat(float(minX + x0)) + laneIndex();
+            vfloat zs(float(minZ + z));
+            vfloat mountain;
+            vfloat height = vSurface(hash, x, zs, vfloat::load(&warp.height[i]), vfloat::load(&warp.mountain[i]),
+                                     vfloat::load(&out.biome[i]), mountain);
+            height.store(&out.height[i]);
+            mountain.store(&out.mountain[i]);
+        }
+    }
+}
+
+template <typename Hash>
+void fillHeightField(const Hash &hash, int minX, int minZ, HeightField &out) {
+    out.minX = minX;
+    out.minZ = minZ;
+    // Rows rounded up to whole vectors
+    const int rowLanes = (HEIGHTFIELD_SAMPLES + SIMD_LANES - 1) / SIMD_LANES * SIMD_LANES;
+    std::array<float, rowLanes> warpX, warpZ, biome;
+    for (int j = 0; j < HEIGHTFIELD_SAMPLES; j++) {
+        for (int i0 = 0; i0 < HEIGHTFIELD_SAMPLES; i0 += SIMD_LANES) {
+            vfloat x = vfloat(float(minX + i0 * HEIGHTFIELD_SPACING)) + laneIndex() * vfloat(float(HEIGHTFIELD_SPACING));
+            vfloat z(float(minZ + j * HEIGHTFIELD_SPACING));
+            vfloat wx, wz, b;
+            vLowFrequency(hash, x, z, wx, wz, b);
+            wx.store(&warpX[i0]);
+            wz.store(&warpZ[i0]);
+            b.store(&biome[i0]);
+        }
+        int row = j * HEIGHTFIELD_SAMPLES;
+        std::copy(warpX.begin(), warpX.begin() + HEIGHTFIELD_SAMPLES, out.warpX.begin() + row);
+        std::copy(warpZ.begin(), warpZ.begin() + HEIGHTFIELD_SAMPLES, out.warpZ.begin() + row);
+        std::copy(biome.begin(), biome.begin() + HEIGHTFIELD_SAMPLES, out.biome.begin() + row);
+    }
+}
+
+} // namespace
+
+void computeHeightmap(int minX, int minZ, const NoiseSettings &settings, ChunkHeightmap &out) {
+    if (settings.backend == NOISE_INTEGER_HASH) {
+        fillHeightmap(IntegerHash{settings.seed}, minX, minZ, out);
+    } else {
+        fillHeightmap(SinFractHash(), minX, minZ, out);
+    }
+}
+
+void computeHeightmap(int minX, int minZ, const NoiseSettings &settings, const HeightField &field,
+                      ChunkHeightmap &out) {
+    if (settings.backend == NOISE_INTEGER_HASH) {
+        fillHeightmap(IntegerHash{settings.seed}, minX, minZ, field, out);
+    } else {
+        fillHeightmap(SinFractHash(), minX, minZ, field, out);
+    }
+}
+
+void computeHeightField(int minX, int minZ, const NoiseSettings &settings, HeightField &out) {
+    if (settings.backend == NOISE_INTEGER_HASH) {
+        fillHeightField(IntegerHash{settings.seed}, minX, minZ, out);
+    } else {
+        fillHeightField(SinFractHash(), minX, minZ, out);
+    }
+}
+
+float HeightField::sample(const Samples &f, int x, int z) const {
+    int dx = x - minX, dz = z - minZ;
+    int i = std::min(dx / HEIGHTFIELD_SPACING, HEIGHTFIELD_SAMPLES - 2);
+    int j = std::min(dz / HEIGHTFIELD_SPACING, HEIGHTFIELD_SAMPLES - 2);
+    float tx = float(dx - i * HEIGHTFIELD_SPACING) / HEIGHTFIELD_SPACING;
+    float tz = float(dz - j * HEIGHTFIELD_SPACING) / HEIGHTFIELD_SPACING;
+    int k = i + HEIGHTFIELD_SAMPLES * j;
+    float low = f[k] + tx * (f[k + 1] - f[k]);
+    float high = f[k + HEIGHTFIELD_SAMPLES] + tx * (f[k + HEIGHTFIELD_SAMPLES + 1] - f[k + HEIGHTFIELD_SAMPLES]);
+    return low + tz * (high - low);
+}
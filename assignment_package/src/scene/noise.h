@@ -0,0 +1,105 @@
+#pragma once
+#include "glm_includes.h"
+#include <array>
+#include <cstdint>
+
+// The noise functions the terrain is generated from, one point at a time.
+// These are the reference versions: computeHeightmap evaluates the same
+// arithmetic for several columns at once and must keep matching them.
+float random1(glm::vec2 p);
+glm::vec2 random2(glm::vec2 p);
+float fbm(glm::vec2 uv);
+float PerlinNoise(glm::vec2 uv);
+float WorleyNoise(glm::vec2 uv);
+float fractalNoise(glm::vec2 uv, float o, float l, float p, float s);
+
+// How the noise functions pick the random value at each lattice point
+enum NoiseBackend : unsigned char {
+    // fract(sin(dot(p, k)) * 43758.5453), as in the reference functions
+    // above. Ignores the seed. Depends on how the platform's sinf rounds,
+    // and repeats visibly once dot(p, k) is large, i.e. thousands of
+    // blocks from the origin.
+    NOISE_SIN_FRACT,
+    // hashLattice() of the integer lattice coordinates and the world seed.
+    // The same on every platform and SIMD width, at any distance.
+    NOISE_INTEGER_HASH
+};
+
+struct NoiseSettings {
+    NoiseBackend backend;
+    uint32_t seed;
+};
+
+// xxHash32's mixing applied to the lattice point (x, y), as two's
+// complement, the seed and a stream number, so that several independent
+// values can be drawn for the same point. U is uint32_t or vuint (see
+// simd.h), which gives the same result in every lane.
+template <typename U>
+U hashLattice(U x, U y, U seed, U stream) {
+    const uint32_t PRIME2 = 2246822519u, PRIME3 = 3266489917u;
+    const uint32_t PRIME4 = 668265263u, PRIME5 = 374761393u;
+    U h = seed + U(PRIME5 + 12);
+    for (U word : {x, y, stream}) {
+        h = h + word * U(PRIME3);
+        h = ((h << 17) | (h >> 15)) * U(PRIME4);
+    }
+    h = (h ^ (h >> 15)) * U(PRIME2);
+    h = (h ^ (h >> 13)) * U(PRIME3);
+    return h ^ (h >> 16);
+}
+
+// The surface of the 16 x 16 columns of one Chunk, indexed x + 16 * z
+struct ChunkHeightmap {
+    std::array<float, 256> height;   // Top block, at most 255
+    std::array<float, 256> mountain; // Height of the mountain biome alone
+    std::array<float, 256> biome;    // 0 is grassland, 1 is mountains
+};
+
+// The noise a terrain generation zone (64 x 64 columns) varies slowly in,
+// sampled every HEIGHTFIELD_SPACING blocks: the fbm() values that warp the
+// grassland's Worley noise and the biome blend. Chunks interpolate these
+// instead of evaluating them per column.
+#define HEIGHTFIELD_SIZE 64
+#define HEIGHTFIELD_SPACING 4
+#define HEIGHTFIELD_SAMPLES (HEIGHTFIELD_SIZE / HEIGHTFIELD_SPACING + 1)
+struct HeightField {
+    using Samples = std::array<float, HEIGHTFIELD_SAMPLES * HEIGHTFIELD_SAMPLES>;
+    // The zone's corner. Sample (i, j), at index i + HEIGHTFIELD_SAMPLES * j,
+    // is at (minX + i * HEIGHTFIELD_SPACING, minZ + j * HEIGHTFIELD_SPACING).
+    int minX, minZ;
+    Samples warpX, warpZ, biome;
+
+    // Bilinear interpolation of one of the fields at a column in the zone
+    float sample(const Samples &field, int x, int z) const;
+};
+void computeHeightField(int minX, int minZ, const NoiseSettings &settings, HeightField &out);
+
+// Fills out for the Chunk whose corner is (minX, minZ), computing
+// SIMD_LANES columns at a time (see simd.h). The result is the same for
+// every SIMD width.
+// With NOISE_INTEGER_HASH the lattice values are exact, so the result is
+// also the same on every platform.
+// With NOISE_SIN_FRACT every step repeats the float and double operations
+// of the reference functions in the same order, except sin(), which is
+// computed in double precision and rounded once, so it always gives the
+// correctly rounded float. Where libm's sinf() does too, the two agree:
+// against a reference using a correctly rounded sin, 0.03% of columns
+// differ in the last bits and no block changes. glibc's sinf() is one ulp
+// off for about 1.3% of the hash inputs, and fract(sin(x) * 43758.5453)
+// magnifies that. Comparing int(height), the top block, with
+// computeHeightmapReference() on glibc 2.36 column by column, the
+// results depend on the area compared. For Chunks with corners in
+// [-256, 256) on x and z, 0.44% of columns change, by at most 1 block.
+// In [-1024, 1024) it is 0.41%, by at most 3, and in [-2048, 2048) it is
+// 0.35%, by at most 8. AVX2, SSE2 and scalar builds agree in
+// [-1024, 1024).
+void computeHeightmap(int minX, int minZ, const NoiseSettings &settings, ChunkHeightmap &out);
+// The same, with the low-frequency noise interpolated from field, the
+// HeightField of the zone containing the Chunk. About 1.7 times as fast,
+// counting the Chunk's share of the HeightField. The warp loses its
+// finest detail, so surfaces differ from the above by 0.15 blocks on
+// average and at most about 2.5.
+void computeHeightmap(int minX, int minZ, const NoiseSettings &settings, const HeightField &field,
+                      ChunkHeightmap &out);
+// NOISE_SIN_FRACT one column at a time, with the reference functions
+void computeHeightmapReference(int minX, int minZ, ChunkHeightmap &out);
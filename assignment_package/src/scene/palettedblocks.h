@@ -0,0 +1,246 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// 16 x 16 x 16 blocks stored as indices into a small palette of the
+// block types that occur in them. An index takes 0 bits when the section
+// is a single type, 1, 2 or 4 bits for up to 2, 4 or 16 types, and 8 bits
+// beyond that. A mostly-air or solid-stone section therefore costs a few
+// bytes instead of 4 KiB.
+// Blocks are ordered y first, so each 16-block column is one run of
+// indices: a single 64-bit word at 4 bits per block.
+// T must be a one-byte type such as BlockType.
+template <typename T>
+class PalettedSection {
+private:
+    std::vector<T> m_palette;
+    // Packed indices, m_bits each; no index straddles two words
+    std::vector<uint64_t> m_data;
+    unsigned char m_bits;
+
+    unsigned int indexAt(int i) const {
+        int bit = i * m_bits;
+        return (m_data[bit >> 6] >> (bit & 63)) & ((1u << m_bits) - 1);
+    }
+
+    void setIndex(int i, unsigned int index) {
+        int bit = i * m_bits;
+        uint64_t mask = ((uint64_t(1) << m_bits) - 1) << (bit & 63);
+        m_data[bit >> 6] = (m_data[bit >> 6] & ~mask) | (uint64_t(index) << (bit & 63));
+    }
+
+    // Index of t in the palette, adding it and widening the indices if needed
+    unsigned int paletteIndex(T t) {
+        auto found = std::find(m_palette.begin(), m_palette.end(), t);
+        unsigned int index = static_cast<unsigned int>(found - m_palette.begin());
+        if (found == m_palette.end()) {
+            m_palette.push_back(t);
+            unsigned char bits = bitsFor(m_palette.size());
+            if (bits != m_bits) {
+                repack(bits);
+            }
+        }
+        return index;
+    }
+
+    static unsigned char bitsFor(size_t paletteSize) {
+        if (paletteSize <= 1) return 0;
+        if (paletteSize <= 2) return 1;
+        if (paletteSize <= 4) return 2;
+        if (paletteSize <= 16) return 4;
+        return 8;
+    }
+
+    // Re-encodes every index with the given width
+    void repack(unsigned char bits) {
+        std::vector<uint64_t> data(bits == 0 ? 0 : VOLUME * bits / 64, 0);
+        std::swap(m_data, data);
+        unsigned char oldBits = m_bits;
+        m_bits = bits;
+        if (bits == 0) {
+            return;
+        }
+        for (int i = 0; i < VOLUME; i++) {
+            unsigned int index = 0;
+            if (oldBits != 0) {
+                int bit = i * oldBits;
+                index = (data[bit >> 6] >> (bit & 63)) & ((1u << oldBits) - 1);
+            }
+            setIndex(i, index);
+        }
+    }
+
+public:
+    static constexpr int SIZE = 16;
+    static constexpr int VOLUME = SIZE * SIZE * SIZE;
+
+    explicit PalettedSection(T fill = T())
+        : m_palette(1, fill), m_data(), m_bits(0)
+    {}
+
+    // i = y + 16 * x + 256 * z
+    T get(int i) const {
+        return m_bits == 0 ? m_palette[0] : m_palette[indexAt(i)];
+    }
+
+    void set(int i, T t) {
+        if (m_bits == 0 && m_palette[0] == t) {
+            return;
+        }
+        setIndex(i, paletteIndex(t));
+    }
+
+    // Sets blocks i to i + count - 1, e.g. part of a column, a word at a time
+    void setRun(int i, int count, T t) {
+        if (count <= 0 || (m_bits == 0 && m_palette[0] == t)) {
+            return;
+        }
+        unsigned int index = paletteIndex(t);
+        // index copied into every m_bits-wide field of a word
+        uint64_t pattern = index * (~uint64_t(0) / ((uint64_t(1) << m_bits) - 1));
+        int bit = i * m_bits, end = (i + count) * m_bits;
+        while (bit < end) {
+            int word = bit >> 6, lo = bit & 63;
+            int n = std::min(end - bit, 64 - lo);
+            uint64_t mask = (n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1) << lo;
+            m_data[word] = (m_data[word] & ~mask) | (pattern & mask);
+            bit += n;
+        }
+    }
+
+    void fill(T t) {
+        m_palette.assign(1, t);
+        m_data.clear();
+        m_data.shrink_to_fit();
+        m_bits = 0;
+    }
+
+    // Drops palette entries no block uses anymore and narrows the indices,
+    // e.g. once a section has been filled block by block
+    void compact() {
+        if (m_bits == 0) {
+            return;
+        }
+        std::array<bool, 256> used{};
+        for (int i = 0; i < VOLUME; i++) {
+            used[indexAt(i)] = true;
+        }
+        std::array<unsigned int, 256> remap{};
+        std::vector<T> palette;
+        for (size_t p = 0; p < m_palette.size(); p++) {
+            if (used[p]) {
+                remap[p] = static_cast<unsigned int>(palette.size());
+                palette.push_back(m_palette[p]);
+            }
+        }
+        if (palette.size() == m_palette.size()) {
+            return;
+        }
+        unsigned char bits = bitsFor(palette.size());
+        if (bits == 0) {
+            fill(palette[0]);
+            return;
+        }
+        std::vector<unsigned int> indices(VOLUME);
+        for (int i = 0; i < VOLUME; i++) {
+            indices[i] = remap[indexAt(i)];
+        }
+        m_palette = std::move(palette);
+        m_data.assign(VOLUME * bits / 64, 0);
+        m_data.shrink_to_fit();
+        m_bits = bits;
+        for (int i = 0; i < VOLUME; i++) {
+            setIndex(i, indices[i]);
+        }
+    }
+
+    bool isUniform() const {
+        return m_bits == 0;
+    }
+    // Only meaningful when isUniform()
+    T uniformType() const {
+        return m_palette[0];
+    }
+    unsigned char bitsPerBlock() const {
+        return m_bits;
+    }
+    // Heap bytes held by this section
+    size_t memoryUsage() const {
+        return m_palette.capacity() * sizeof(T) + m_data.capacity() * sizeof(uint64_t);
+    }
+};
+
+// A SX x SY x SZ volume of blocks split into 16^3 PalettedSections.
+// get() and set() stay O(1): one section lookup, then one shift and mask.
+// Sections are ordered x, then y, then z.
+template <typename T, int SX, int SY, int SZ>
+class PalettedBlocks {
+public:
+    using Section = PalettedSection<T>;
+    static constexpr int SECTIONS_X = SX / Section::SIZE;
+    static constexpr int SECTIONS_Y = SY / Section::SIZE;
+    static constexpr int SECTIONS_Z = SZ / Section::SIZE;
+    static constexpr int SECTION_COUNT = SECTIONS_X * SECTIONS_Y * SECTIONS_Z;
+    static_assert(SX % Section::SIZE == 0 && SY % Section::SIZE == 0 && SZ % Section::SIZE == 0,
+                  "PalettedBlocks dimensions must be multiples of 16");
+
+private:
+    std::array<Section, SECTION_COUNT> m_sections;
+
+    static int sectionIndex(int x, int y, int z) {
+        return (x >> 4) + SECTIONS_X * ((y >> 4) + SECTIONS_Y * (z >> 4));
+    }
+    static int localIndex(int x, int y, int z) {
+        return (y & 15) + 16 * (x & 15) + 256 * (z & 15);
+    }
+
+public:
+    explicit PalettedBlocks(T fill = T()) {
+        m_sections.fill(Section(fill));
+    }
+
+    T get(int x, int y, int z) const {
+        return m_sections[sectionIndex(x, y, z)].get(localIndex(x, y, z));
+    }
+    void set(int x, int y, int z, T t) {
+        m_sections[sectionIndex(x, y, z)].set(localIndex(x, y, z), t);
+    }
+    // Sets the blocks from yStart up to, but not including, yEnd in the
+    // column (x, z), one setRun per section
+    void fillColumn(int x, int z, int yStart, int yEnd, T t) {
+        while (yStart < yEnd) {
+            int sectionEnd = std::min(yEnd, (yStart & ~15) + 16);
+            m_sections[sectionIndex(x, yStart, z)].setRun(localIndex(x, yStart, z), sectionEnd - yStart, t);
+            yStart = sectionEnd;
+        }
+    }
+    void fill(T t) {
+        for (Section &s : m_sections) {
+            s.fill(t);
+        }
+    }
+    void compact() {
+        for (Section &s : m_sections) {
+            s.compact();
+        }
+    }
+
+    const Section& section(int sx, int sy, int sz) const {
+        return m_sections[sx + SECTIONS_X * (sy + SECTIONS_Y * sz)];
+    }
+    // Section holding block (x, y, z)
+    const Section& sectionAt(int x, int y, int z) const {
+        return m_sections[sectionIndex(x, y, z)];
+    }
+
+    // Bytes used by the block data, including what the sections allocated
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(*this);
+        for (const Section &s : m_sections) {
+            bytes += s.memoryUsage();
+        }
+        return bytes;
+    }
+};
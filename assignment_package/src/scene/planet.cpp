@@ -1,14 +1,14 @@
 #include "planet.h"
+#include <stdexcept>
+#include <string>
 
 Planet_Chunk::Planet_Chunk(int x, int y, int z, glm::vec3 center, OpenGLContext* context): Drawable(context),
-    minX(x), minY(y), minZ(z), center(center), m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}, {YPOS, nullptr}, {YNEG, nullptr}}
-{
-    std::fill_n(m_blocks.begin(), 262144, EMPTY);
-}
+    m_blocks(EMPTY), minX(x), minY(y), minZ(z), center(center), m_neighbors{}
+{}
 
-// Does bounds checking with at()
+// Does bounds checking like std::array::at()
 BlockType Planet_Chunk::getBlockAt(unsigned int x, unsigned int y, unsigned int z) const {
-    return m_blocks.at(x + 64 * y + 64 * 64 * z);
+    return m_blocks.getChecked(x, y, z);
 }
 
 // Exists to get rid of compiler warnings about int -> unsigned int implicit conversion
@@ -16,238 +16,65 @@ BlockType Planet_Chunk::getBlockAt(int x, int y, int z) const {
     return getBlockAt(static_cast<unsigned int>(x), static_cast<unsigned int>(y), static_cast<unsigned int>(z));
 }
 
-// Does bounds checking with at()
+// Does bounds checking like std::array::at()
 void Planet_Chunk::setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
-    m_blocks.at(x + 64 * y + 64 * 64 * z) = t;
+    m_blocks.setChecked(x, y, z, t);
 }
 
-const static std::unordered_map<Direction, Direction, EnumHash> oppositeDirection {
-    {XPOS, XNEG},
-    {XNEG, XPOS},
-    {YPOS, YNEG},
-    {YNEG, YPOS},
-    {ZPOS, ZNEG},
-    {ZNEG, ZPOS}
-};
+void Planet_Chunk::compactBlocks() {
+    m_blocks.compact();
+}
 
 void Planet_Chunk::linkNeighbor(uPtr<Planet_Chunk> &neighbor, Direction dir) {
     if(neighbor != nullptr) {
         this->m_neighbors[dir] = neighbor.get();
-        neighbor->m_neighbors[oppositeDirection.at(dir)] = this;
-    }
-}
-
-std::vector<glm::vec4> Planet_Chunk::findFace(glm::ivec3 n) {
-    std::vector<glm::vec4> result;
-    if (n.x == 1) {
-        result.push_back(glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-    }
-    if (n.x == -1) {
-        result.push_back(glm::vec4(0.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-    }
-    if (n.y == 1) {
-        result.push_back(glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-    }
-    if (n.y == -1) {
-        result.push_back(glm::vec4(1.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
-    }
-    if (n.z == 1) {
-        result.push_back(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 1.0f, 1.0f, 1.0f));
-    }
-    if (n.z == -1) {
-        result.push_back(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-        result.push_back(glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
-    }
-    return result;
-}
-
-glm::vec3 Planet_Chunk::findColor(BlockType t) {
-    switch(t) {
-        case GRASS:
-            return glm::vec3(95.f, 159.f, 53.f) / 255.f;
-        case DIRT:
-            return glm::vec3(121.f, 85.f, 58.f) / 255.f;
-        case STONE:
-            return glm::vec3(0.5f);
-        case WATER:
-            return glm::vec3(0.f, 0.f, 0.75f);
-        case SNOW:
-            return glm::vec3(1.f, 1.f, 1.f);
-        case LAVA:
-            return glm::vec3(207.f, 16.f, 32.f) / 255.f;
-        default:
-            // Other block types are not yet handled, so we default to debug purple
-            return glm::vec3(1.f, 0.f, 1.f);
-    }
-}
-
-std::vector<glm::vec4> Planet_Chunk::findUV(BlockType t, glm::ivec3 n) {
-    std::vector<glm::vec4> results;
-    switch(t) {
-        case GRASS:
-            if (n.y == 1) {
-                results.push_back(glm::vec4(8.f, 14.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(8.f, 13.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(9.f, 13.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(9.f, 14.f, 0, 0) / 16.f);
-            }
-            else if (n.y == -1) {
-                results.push_back(glm::vec4(2.f, 16.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(2.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(3.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(3.f, 16.f, 0, 0) / 16.f);
-            }
-            else {
-                results.push_back(glm::vec4(3.f, 16.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(3.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(4.f, 15.f, 0, 0) / 16.f);
-                results.push_back(glm::vec4(4.f, 16.f, 0, 0) / 16.f);
-            }
-        case DIRT:
-            results.push_back(glm::vec4(3.f, 16.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(3.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(4.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(4.f, 16.f, 0, 0) / 16.f);
-        case STONE:
-            results.push_back(glm::vec4(1.f, 16.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(1.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(2.f, 15.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(2.f, 16.f, 0, 0) / 16.f);
-        case WATER:
-            results.push_back(glm::vec4(13.f, 4.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(13.f, 3.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(14.f, 3.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(14.f, 4.f, 0, 0) / 16.f);
-        case SNOW:
-            results.push_back(glm::vec4(2.f, 12.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(2.f, 11.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(3.f, 11.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(3.f, 12.f, 0, 0) / 16.f);
-        case LAVA:
-            results.push_back(glm::vec4(13.f, 2.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(13.f, 1.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(14.f, 1.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(14.f, 2.f, 0, 0) / 16.f);
-        default:
-            results.push_back(glm::vec4(7.f, 2.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(7.f, 1.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(8.f, 1.f, 0, 0) / 16.f);
-            results.push_back(glm::vec4(8.f, 2.f, 0, 0) / 16.f);
+        neighbor->m_neighbors[oppositeDirection[dir]] = this;
     }
-    return results;
 }
 
-bool Planet_Chunk::checkBound(int x, int y, int z) {
-    if (x < 0 || x > 63) {
-        return false;
-    } else if (y < 0 || y > 63) {
-        return false;
-    } else if (z < 0 || z > 63) {
-        return false;
-    }
-    return true;
-}
-
-bool Planet_Chunk::checkNeighbor(int x, int y, int z, BlockType t) {
-    if (t == WATER) return false;
-    if (x == -1) {
-        if (m_neighbors[XNEG]) {
-            if (m_neighbors[XNEG]->getBlockAt(63, y, z) == EMPTY ||
-                m_neighbors[XNEG]->getBlockAt(63, y, z) == WATER) return true;
-            return false;
-        } else {
-            return true;
-        }
-    }
-    if (x == 64) {
-        if (m_neighbors[XPOS]) {
-            if (m_neighbors[XPOS]->getBlockAt(0, y, z) == EMPTY ||
-                m_neighbors[XPOS]->getBlockAt(0, y, z) == WATER) return true;
-            return false;
-        } else {
-            return true;
-        }
-    }
-    if (z == -1) {
-        if (m_neighbors[ZNEG]) {
-            if (m_neighbors[ZNEG]->getBlockAt(x, y, 63) == EMPTY ||
-                m_neighbors[ZNEG]->getBlockAt(x, y, 63) == WATER) return true;
-            return false;
-        } else {
-            return true;
-        }
-    }
-    if (z == 64) {
-        if (m_neighbors[ZPOS]) {
-            if (m_neighbors[ZPOS]->getBlockAt(x, y, 0) == EMPTY ||
-                m_neighbors[ZPOS]->getBlockAt(x, y, 0)  == WATER) return true;
-            return false;
-        } else {
-            return true;
+void Planet_Chunk::copyPaddedSection(int sx, int sy, int sz, PaddedSection &out) const {
+    // Blocks past a face come from the neighbor on that side, or count as
+    // EMPTY where there is none. The border's edges and corners are never
+    // read by computeFaceMasks.
+    auto outside = [this](int x, int y, int z) -> BlockType {
+        bool xOut = !PlanetBlocks::contains(x, 0, 0);
+        bool yOut = !PlanetBlocks::contains(0, y, 0);
+        bool zOut = !PlanetBlocks::contains(0, 0, z);
+        if (xOut + yOut + zOut != 1) {
+            return EMPTY;
         }
-    }
-    if (y == -1) {
-        if (m_neighbors[YNEG]) {
-            if (m_neighbors[YNEG]->getBlockAt(x, 63, z) == EMPTY ||
-                m_neighbors[YNEG]->getBlockAt(x, 63, z) == WATER) return true;
-            return false;
-        } else {
-            return true;
-        }
-    }
-    if (y == 64) {
-        if (m_neighbors[YPOS]) {
-            if (m_neighbors[YPOS]->getBlockAt(x, 0, z) == EMPTY ||
-                m_neighbors[YPOS]->getBlockAt(x, 0, z) == WATER) return true;
-            return false;
-        } else {
-            return true;
-        }
-    }
-    return false;
+        Direction dir = xOut ? (x < 0 ? XNEG : XPOS)
+                      : yOut ? (y < 0 ? YNEG : YPOS)
+                             : (z < 0 ? ZNEG : ZPOS);
+        const Planet_Chunk *n = m_neighbors[dir];
+        return n != nullptr ? n->m_blocks.get(x & 63, y & 63, z & 63) : EMPTY;
+    };
+    m_blocks.copyPaddedSection(sx, sy, sz, out, outside);
 }
 
-bool Planet_Chunk::checkConidtions(int x, int y, int z, const glm::ivec3& n, BlockType t) {
-    if (checkNeighbor(x+n.x, y+n.y, z+n.z, t)) {
-        return true;
-    } else if (checkBound(x+n.x, y+n.y, z+n.z)) {
-        if (getBlockAt(x+n.x, y+n.y, z+n.z) == EMPTY) {
-            return true;
-        } else if (t != WATER && getBlockAt(x+n.x, y+n.y, z+n.z) == WATER) {
-            return true;
-        }
+void Planet_Chunk::appendFace(std::vector<glm::vec4> &data, glm::ivec3 pos, Direction dir, BlockType t) {
+    // Same UV layout as Chunk: tile corner in xy, tile-space coordinates in zw
+    static const glm::vec2 tileCorners[4] = {glm::vec2(0, 1), glm::vec2(0, 0),
+                                             glm::vec2(1, 0), glm::vec2(1, 1)};
+    AtlasTile tile = blockTile(t, dir);
+    glm::vec2 uv = glm::vec2(tile.col, tile.row) / 16.f;
+    glm::vec3 local = glm::vec3(pos) + glm::vec3(minX, minY, minZ);
+    glm::vec4 normal = glm::vec4(-glm::normalize(local), 1);
+    glm::vec4 color = glm::vec4(blockColors[t][0], blockColors[t][1], blockColors[t][2], 1.);
+    for (int i = 0; i < 4; i++) {
+        const int *c = faceCorners[dir][i];
+        data.push_back(glm::vec4(local + center + glm::vec3(c[0], c[1], c[2]), 1.));
+        data.push_back(normal);
+        data.push_back(color);
+        data.push_back(glm::vec4(uv, tileCorners[i]));
     }
-    return false;
 }
 
-void Planet_Chunk::bindBuffer(const std::vector<glm::vec4> &d, const std::vector<glm::vec4> &d_trans,
-                       const std::vector<GLuint> &i, const std::vector<GLuint> &i_trans) {
-    m_count = i.size();
-    m_count_trans = i_trans.size();
-    generateIdx();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), i.data(), GL_STATIC_DRAW);
-
-    generateIdxTrans();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxTrans);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count_trans * sizeof(GLuint), i_trans.data(), GL_STATIC_DRAW);
+void Planet_Chunk::bindBuffer(const std::vector<glm::vec4> &d, const std::vector<glm::vec4> &d_trans) {
+    // Four interleaved vec4s per vertex and four vertices per quad
+    m_count = d.size() / 16 * 6;
+    m_count_trans = d_trans.size() / 16 * 6;
+    useQuadIndices();
 
     generateInter();
     mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufInter);
@@ -263,80 +90,36 @@ void Planet_Chunk::bindBuffer(const std::vector<glm::vec4> &d, const std::vector
 void Planet_Chunk::createVBOdata() {
     std::vector<glm::vec4> data;
     std::vector<glm::vec4> data_trans;
-    std::vector<GLuint> indices;
-    std::vector<GLuint> indices_trans;
-    int curSize = 0;
-    int curSize_trans = 0;
-    std::vector<glm::ivec3> neighbors = {glm::ivec3(1, 0, 0),
-                                        glm::ivec3(-1, 0, 0),
-                                        glm::ivec3(0, 1, 0),
-                                        glm::ivec3(0, -1, 0),
-                                        glm::ivec3(0, 0, 1),
-                                        glm::ivec3(0, 0, -1)};
-
-    for (int x = 0; x < 64; x++) {
-        for (int y = 0; y < 64; y++) {
-            for (int z = 0; z < 64; z++) {
-                BlockType t = getBlockAt(x, y, z);
-                if (t != EMPTY) {
-                    for (auto const& n:neighbors) {
-                        if (checkConidtions(x, y, z, n, t)) {
-                            auto offsets = findFace(n);
-                            auto UVs = findUV(t, n);
-                            if (t == WATER && n.y != 1) continue; // ensure only draw the water level
-                            if (t == WATER) {
-                                for (int i = 0; i < 4; i++) {
-                                    data_trans.push_back(glm::vec4(x+ this->minX + center.x, y + this->minY + center.y, z + this->minZ + center.z, 0.) + offsets[i]);
-                                    data.push_back(glm::vec4(-glm::normalize(glm::vec3(x + this->minX, y + this->minY, z + this->minZ)), 1));
-                                    data_trans.push_back(glm::vec4(findColor(t), 1.));
-                                    data_trans.push_back(UVs[i]);
-                                }
-                                indices_trans.push_back(curSize_trans);
-                                indices_trans.push_back(curSize_trans + 1);
-                                indices_trans.push_back(curSize_trans + 2);
-                                indices_trans.push_back(curSize_trans);
-                                indices_trans.push_back(curSize_trans + 2);
-                                indices_trans.push_back(curSize_trans + 3);
-                                curSize_trans += 4;
-                            } else {
-                                for (int i = 0; i < 4; i++) {
-                                    data.push_back(glm::vec4(x + this->minX + center.x, y + this->minY + center.y, z + this->minZ + center.z, 0.) + offsets[i]);
-                                    data.push_back(glm::vec4(-glm::normalize(glm::vec3(x + this->minX, y + this->minY, z + this->minZ)), 1));
-                                    data.push_back(glm::vec4(findColor(t), 1.));
-                                    data.push_back(UVs[i]);
-                                }
-                                indices.push_back(curSize);
-                                indices.push_back(curSize + 1);
-                                indices.push_back(curSize + 2);
-                                indices.push_back(curSize);
-                                indices.push_back(curSize + 2);
-                                indices.push_back(curSize + 3);
-                                curSize += 4;
-                            }
-                        } else {
-                            continue;
+    // The same face culling as Chunk, one 16x16x16 section at a time
+    PaddedSection padded;
+    SectionFaceMasks masks;
+    for (int sz = 0; sz < PlanetBlocks::SECTIONS_Z; sz++) {
+        for (int sy = 0; sy < PlanetBlocks::SECTIONS_Y; sy++) {
+            for (int sx = 0; sx < PlanetBlocks::SECTIONS_X; sx++) {
+                const auto &section = m_blocks.section(sx, sy, sz);
+                if (section.isUniform() && section.uniformType() == EMPTY) {
+                    continue;
+                }
+                copyPaddedSection(sx, sy, sz, padded);
+                computeFaceMasks(padded, masks);
+                for (int f = 0; f < 6; f++) {
+                    for (int column = 0; column < 16 * 16; column++) {
+                        int x = column & 15, z = column >> 4;
+                        for (uint32_t bits = masks.visible[f][column]; bits != 0; bits &= bits - 1) {
+                            int y = lowestBit(bits);
+                            BlockType t = padded[paddedIndex(x, y, z)];
+                            appendFace(t == WATER ? data_trans : data,
+                                       glm::ivec3(16 * sx + x, 16 * sy + y, 16 * sz + z), Direction(f), t);
                         }
                     }
-                } else {
-                    continue;
                 }
             }
         }
     }
 
-    bindBuffer(data, data_trans, indices, indices_trans);
+    bindBuffer(data, data_trans);
     vbo_created = true;
     buffer_created = true;
-//    PlanetVBOData storedData;
-//    storedData.chunk = this;
-//    storedData.d = data;
-//    storedData.d_trans = data_trans;
-//    storedData.idx = indices;
-//    storedData.idx_trans = indices_trans;
-
-//    mu.lock();
-//    vboData.push_back(storedData);
-//    mu.unlock();
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -478,6 +261,7 @@ void Planet::createPlanet() {
     }
 
     for (const auto &[key, chunk] : m_chunks) {
+        chunk->compactBlocks();
         chunk->createVBOdata();
     }
 }
@@ -6,14 +6,26 @@
 #include "chunk.h"
 #include "shaderprogram.h"
 
+// A Planet_Chunk's blocks
+using PlanetBlocks = VoxelVolume<64, 64, 64>;
+
 class Planet_Chunk: public Drawable
 {
 private:
-    // All of the blocks contained within this Chunk
-    std::array<BlockType, 262144> m_blocks;
+    // All of the blocks contained within this Chunk, as 64 paletted
+    // 16x16x16 sections; most of a planet chunk is EMPTY or solid
+    PlanetBlocks m_blocks;
     int minX, minY, minZ;
     glm::vec3 center;
-    std::unordered_map<Direction, Planet_Chunk*, EnumHash> m_neighbors;
+    // Indexed by Direction; nullptr where there is no neighbor
+    std::array<Planet_Chunk*, 6> m_neighbors;
+
+    // Section (sx, sy, sz) and the border around it, read from the
+    // neighbors where it leaves this Planet_Chunk
+    void copyPaddedSection(int sx, int sy, int sz, PaddedSection &out) const;
+    // Appends the four vertices of the dir face of the block at
+    // chunk-local pos
+    void appendFace(std::vector<glm::vec4> &data, glm::ivec3 pos, Direction dir, BlockType t);
 
 public:
     bool vbo_created=false;
@@ -25,23 +37,17 @@ public:
     BlockType getBlockAt(unsigned int x, unsigned int y, unsigned int z) const;
     BlockType getBlockAt(int x, int y, int z) const;
     void setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t);
+    // Shrinks every section's palette to the types it still uses
+    void compactBlocks();
     void linkNeighbor(uPtr<Planet_Chunk>& neighbor, Direction dir);
-    std::vector<glm::vec4> findFace(glm::ivec3);
-    glm::vec3 findColor(BlockType);
-    std::vector<glm::vec4> findUV(BlockType, glm::ivec3);
-    bool checkBound(int, int, int);
-    bool checkNeighbor(int, int, int, BlockType);
-    bool checkConidtions(int, int, int, const glm::ivec3&, BlockType);
-    void bindBuffer(const std::vector<glm::vec4>&, const std::vector<glm::vec4>&,
-                    const std::vector<GLuint>&, const std::vector<GLuint>&);
+    // Uploads the opaque and transparent vertices, four per quad
+    void bindBuffer(const std::vector<glm::vec4>&, const std::vector<glm::vec4>&);
 };
 
 struct PlanetVBOData {
     Planet_Chunk* chunk;
     std::vector<glm::vec4> d;
     std::vector<glm::vec4> d_trans;
-    std::vector<GLuint> idx;
-    std::vector<GLuint> idx_trans;
 };
 
 // helper functions to convert (x, y, z) to and from the hash map key
@@ -1,4 +1,5 @@
 #include "player.h"
+#include "profiler.h"
 #include <QString>
 
 // Copy from slide Minecraft Grid Marching P15
@@ -110,7 +111,10 @@ void Player::processInputs(InputBundle &inputs) {
             m_acceleration.z = 0;
         }
 
-        BlockType downBlock = mcr_terrain.getBlockAt(m_position.x, m_position.y - 0.5, m_position.z);
+        // Above the column's top block there is nothing to stand on, which
+        // the heightmap tells without reading any blocks
+        int x = m_position.x, y = m_position.y - 0.5f, z = m_position.z;
+        BlockType downBlock = y >= mcr_terrain.getColumnHeight(x, z) ? EMPTY : mcr_terrain.getBlockAt(x, y, z);
         if (downBlock == EMPTY) {
             // If there's no block under the player, apply gravity
             m_acceleration.y = -g * m_up.y;
@@ -129,6 +133,7 @@ void Player::processInputs(InputBundle &inputs) {
 }
 
 void Player::computePhysics(float dT, const Terrain &terrain) {
+    PROFILE_SCOPE("Player::computePhysics");
     // TODO: Update the Player's position based on its acceleration
     // and velocity, and also perform collision detection.
     m_velocity *= 0.95; // friction and drag
@@ -275,11 +280,9 @@ void Player::removeBlock() {
             return;
         }
 
-        // If there is a block overlapping the center of the screen
+        // If there is a block overlapping the center of the screen.
+        // The Terrain remeshes the affected sections in the background.
         mcr_terrain.setBlockAt(out_blockHit.x, out_blockHit.y, out_blockHit.z, EMPTY);
-        const uPtr<Chunk>& c = mcr_terrain.getChunkAt(out_blockHit.x, out_blockHit.z);
-        c->destroyVBOdata();
-        c->createVBOdata();
     }
 }
 
@@ -292,17 +295,10 @@ void Player::placeBlock() {
     if (!isBlock) {
         // If there is no block
         out_blockHit = m_camera.mcr_position + 3.f * glm::normalize(this->m_forward);
-        Chunk* c = mcr_terrain.getChunkAt(out_blockHit.x, out_blockHit.z).get();
-        glm::vec2 chunkOrigin = glm::vec2(floor(out_blockHit.x / 16.f) * 16, floor(out_blockHit.z / 16.f) * 16);
-
-        if (c->getBlockAt(static_cast<unsigned int>(out_blockHit.x - chunkOrigin.x),
-                          static_cast<unsigned int>(out_blockHit.y),
-                          static_cast<unsigned int>(out_blockHit.z - chunkOrigin.y)) == EMPTY) {
-            c->setBlockAt(static_cast<unsigned int>(out_blockHit.x - chunkOrigin.x),
-                          static_cast<unsigned int>(out_blockHit.y),
-                          static_cast<unsigned int>(out_blockHit.z - chunkOrigin.y), STONE);
-            c->destroyVBOdata();
-            c->createVBOdata();
+        // Goes through the Terrain so a block on a Chunk's border also
+        // updates the neighboring Chunk's mesh
+        if (mcr_terrain.getBlockAt(out_blockHit.x, out_blockHit.y, out_blockHit.z) == EMPTY) {
+            mcr_terrain.setBlockAt(out_blockHit.x, out_blockHit.y, out_blockHit.z, STONE);
         }
     }
 }
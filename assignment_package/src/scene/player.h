@@ -3,6 +3,11 @@
 #include "camera.h"
 #include "terrain.h"
 
+// Steps through the blocks along rayDirection from rayOrigin, as far as
+// rayDirection's length. Returns true and the first non-EMPTY block and its
+// distance if there is one. Every block on the way must be in a loaded Chunk.
+bool gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &terrain, float *out_dist, glm::ivec3 *out_blockHit);
+
 class Player : public Entity {
 private:
     glm::vec3 m_velocity, m_acceleration;
@@ -5,7 +5,6 @@ Quad::Quad(OpenGLContext *context) : Drawable(context)
 
 void Quad::createVBOdata()
 {
-    GLuint idx[6]{0, 1, 2, 0, 2, 3};
     glm::vec4 vert_pos[4] {glm::vec4(-1.f, -1.f, 0.999999f, 1.f),
                            glm::vec4(1.f, -1.f, 0.999999f, 1.f),
                            glm::vec4(1.f, 1.f, 0.999999f, 1.f),
@@ -17,18 +16,10 @@ void Quad::createVBOdata()
 //                          glm::vec2(0.f, 1.f)};
 
     m_count = 6;
+    // One quad, so its two triangles come from the shared quad index buffer
+    useQuadIndices();
 
-    // Create a VBO on our GPU and store its handle in bufIdx
-    generateIdx();
-    // Tell OpenGL that we want to perform subsequent operations on the VBO referred to by bufIdx
-    // and that it will be treated as an element array buffer (since it will contain triangle indices)
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    // Pass the data stored in cyl_idx into the bound buffer, reading a number of bytes equal to
-    // CYL_IDX_COUNT multiplied by the size of a GLuint. This data is sent to the GPU to be read by shader programs.
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * sizeof(GLuint), idx, GL_STATIC_DRAW);
-
-    // The next few sets of function calls are basically the same as above, except bufPos and bufNor are
-    // array buffers rather than element array buffers, as they store vertex attributes like position.
+    // Vertex attributes like position go in array buffers
     generatePos();
     mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
     mp_context->glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(glm::vec4), vert_pos, GL_STATIC_DRAW);
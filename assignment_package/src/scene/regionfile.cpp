@@ -0,0 +1,302 @@
+#include "regionfile.h"
+#include "chunkkey.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t REGION_MAGIC = 0x4752434d; // "MCRG"
+static const uint32_t REGION_VERSION = 1;
+
+RegionFile::RegionFile(const std::string &path)
+    : m_mutex(), m_path(path), m_file(), m_header(), m_fileSize(0), m_freeExtents(),
+      m_fd(-1), mp_map(nullptr), m_mapSize(0)
+{
+    m_header.fill(Entry{0, 0, 0});
+    m_file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (m_file.is_open()) {
+        uint32_t magic = 0, version = 0;
+        m_file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        m_file.read(reinterpret_cast<char*>(&version), sizeof(version));
+        m_file.read(reinterpret_cast<char*>(m_header.data()), sizeof(Entry) * m_header.size());
+        if (!m_file || magic != REGION_MAGIC || version != REGION_VERSION) {
+            // Not something we can read; start over rather than crash on it
+            m_file.close();
+            m_header.fill(Entry{0, 0, 0});
+        }
+    }
+    if (!m_file.is_open()) {
+        m_file.clear();
+        m_file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m_file.is_open()) {
+            return;
+        }
+        m_file.write(reinterpret_cast<const char*>(&REGION_MAGIC), sizeof(REGION_MAGIC));
+        m_file.write(reinterpret_cast<const char*>(&REGION_VERSION), sizeof(REGION_VERSION));
+        m_file.write(reinterpret_cast<const char*>(m_header.data()), sizeof(Entry) * m_header.size());
+        m_file.flush();
+    }
+    m_file.clear();
+    m_file.seekg(0, std::ios::end);
+    m_fileSize = static_cast<uint64_t>(m_file.tellg());
+    findFreeExtents();
+#ifndef _WIN32
+    m_fd = ::open(path.c_str(), O_RDONLY);
+#endif
+}
+
+RegionFile::~RegionFile() {
+    unmap();
+#ifndef _WIN32
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+}
+
+bool RegionFile::isOpen() const {
+    return m_file.is_open();
+}
+
+void RegionFile::unmap() {
+#ifndef _WIN32
+    if (mp_map != nullptr) {
+        munmap(mp_map, m_mapSize);
+    }
+#endif
+    mp_map = nullptr;
+    m_mapSize = 0;
+}
+
+void RegionFile::remap() {
+    unmap();
+#ifndef _WIN32
+    if (m_fd < 0 || m_fileSize == 0) {
+        return;
+    }
+    void *map = mmap(nullptr, m_fileSize, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (map != MAP_FAILED) {
+        mp_map = static_cast<unsigned char*>(map);
+        m_mapSize = m_fileSize;
+    }
+#endif
+}
+
+bool RegionFile::read(int localX, int localZ, std::vector<unsigned char> &out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Entry &e = m_header[localX + REGION_CHUNKS * localZ];
+    if (e.offset == 0 || !m_file.is_open()) {
+        return false;
+    }
+    uint64_t end = static_cast<uint64_t>(e.offset) + e.length;
+    if (end > m_mapSize) {
+        remap();
+    }
+    out.resize(e.length);
+    if (end <= m_mapSize) {
+        std::memcpy(out.data(), mp_map + e.offset, e.length);
+        return true;
+    }
+    // No mapping on this platform, or mmap failed
+    m_file.clear();
+    m_file.seekg(e.offset);
+    m_file.read(reinterpret_cast<char*>(out.data()), e.length);
+    return static_cast<bool>(m_file);
+}
+
+void RegionFile::write(int localX, int localZ, const std::vector<unsigned char> &data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file.is_open()) {
+        return;
+    }
+    int index = localX + REGION_CHUNKS * localZ;
+    Entry &e = m_header[index];
+    Entry old = e;
+    if (e.offset == 0 || data.size() > e.capacity) {
+        e.offset = allocateExtent(static_cast<uint32_t>(data.size()));
+        e.capacity = static_cast<uint32_t>(data.size());
+    }
+    e.length = static_cast<uint32_t>(data.size());
+    m_file.clear();
+    m_file.seekp(e.offset);
+    m_file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    // Update the header only after the data is written, so a crash while
+    // moving leaves the entry pointing at the old copy. For the same
+    // reason the old extent is only reused by later writes.
+    writeEntry(index);
+    m_file.flush();
+    if (old.offset != 0 && old.offset != e.offset) {
+        freeExtent(old.offset, old.capacity);
+    }
+}
+
+void RegionFile::findFreeExtents() {
+    m_freeExtents.clear();
+    std::vector<std::pair<uint64_t, uint64_t>> used;
+    for (const Entry &e : m_header) {
+        if (e.offset != 0) {
+            used.emplace_back(e.offset, static_cast<uint64_t>(e.offset) + e.capacity);
+        }
+    }
+    std::sort(used.begin(), used.end());
+    uint64_t pos = 2 * sizeof(uint32_t) + sizeof(Entry) * m_header.size();
+    for (auto &[begin, end] : used) {
+        if (begin > pos) {
+            m_freeExtents[static_cast<uint32_t>(pos)] = static_cast<uint32_t>(begin - pos);
+        }
+        pos = std::max(pos, end);
+    }
+    if (m_fileSize > pos) {
+        m_freeExtents[static_cast<uint32_t>(pos)] = static_cast<uint32_t>(m_fileSize - pos);
+    }
+}
+
+uint32_t RegionFile::allocateExtent(uint32_t size) {
+    for (auto it = m_freeExtents.begin(); it != m_freeExtents.end(); ++it) {
+        if (it->second >= size) {
+            uint32_t offset = it->first;
+            if (it->second > size) {
+                m_freeExtents[offset + size] = it->second - size;
+            }
+            m_freeExtents.erase(it);
+            return offset;
+        }
+    }
+    uint32_t offset = static_cast<uint32_t>(m_fileSize);
+    m_fileSize += size;
+    return offset;
+}
+
+void RegionFile::freeExtent(uint32_t offset, uint32_t size) {
+    if (size == 0) {
+        return;
+    }
+    // Merge with the free extents on either side
+    auto next = m_freeExtents.lower_bound(offset);
+    if (next != m_freeExtents.end() && next->first == offset + size) {
+        size += next->second;
+        next = m_freeExtents.erase(next);
+    }
+    if (next != m_freeExtents.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            m_freeExtents.erase(prev);
+        }
+    }
+    m_freeExtents[offset] = size;
+}
+
+void RegionFile::writeEntry(int index) {
+    m_file.seekp(2 * sizeof(uint32_t) + index * sizeof(Entry));
+    m_file.write(reinterpret_cast<const char*>(&m_header[index]), sizeof(Entry));
+}
+
+RegionStore::RegionStore()
+    : m_mutex(), m_writeMutex(), m_directory(), m_regions(), m_pending()
+{}
+
+void RegionStore::setDirectory(const std::string &directory) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_regions.clear();
+    std::error_code err;
+    std::filesystem::create_directories(directory, err);
+    m_directory = err ? "" : directory;
+}
+
+bool RegionStore::isEnabled() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_directory.empty();
+}
+
+RegionFile* RegionStore::getRegion(int x, int z) {
+    if (m_directory.empty()) {
+        return nullptr;
+    }
+    int rx = static_cast<int>(std::floor(x / (16.f * REGION_CHUNKS)));
+    int rz = static_cast<int>(std::floor(z / (16.f * REGION_CHUNKS)));
+    uPtr<RegionFile> &region = m_regions[toKey(rx, rz)];
+    if (region == nullptr) {
+        region = mkU<RegionFile>(m_directory + "/r." + std::to_string(rx) + "." +
+                                 std::to_string(rz) + ".region");
+    }
+    return region->isOpen() ? region.get() : nullptr;
+}
+
+// Index of the Chunk at world-space corner (x, z) within its region
+static int localIndex(int v) {
+    int c = static_cast<int>(std::floor(v / 16.f));
+    return ((c % REGION_CHUNKS) + REGION_CHUNKS) % REGION_CHUNKS;
+}
+
+bool RegionStore::read(int x, int z, std::vector<unsigned char> &out) {
+    RegionFile *region = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_pending.find(toKey(x, z));
+        if (it != m_pending.end()) {
+            out = it->second;
+            return true;
+        }
+        region = getRegion(x, z);
+    }
+    return region != nullptr && region->read(localIndex(x), localIndex(z), out);
+}
+
+void RegionStore::queueWrite(int x, int z, std::vector<unsigned char> data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_directory.empty()) {
+        m_pending[toKey(x, z)] = std::move(data);
+    }
+}
+
+void RegionStore::writePending(int x, int z) {
+    PROFILE_SCOPE("RegionStore::writePending");
+    // One write at a time, so an older copy of a Chunk can never land on
+    // disk after a newer one
+    std::lock_guard<std::mutex> writeLock(m_writeMutex);
+    std::vector<unsigned char> data;
+    RegionFile *region = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_pending.find(toKey(x, z));
+        if (it == m_pending.end()) {
+            return;
+        }
+        data = it->second;
+        region = getRegion(x, z);
+    }
+    if (region != nullptr) {
+        region->write(localIndex(x), localIndex(z), data);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Only forget the data if it wasn't replaced while it was being written
+    auto it = m_pending.find(toKey(x, z));
+    if (it != m_pending.end() && it->second == data) {
+        m_pending.erase(it);
+    }
+}
+
+void RegionStore::flush() {
+    std::vector<int64_t> keys;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &[key, data] : m_pending) {
+            keys.push_back(key);
+        }
+    }
+    for (int64_t key : keys) {
+        glm::ivec2 xz = toCoords(key);
+        writePending(xz.x, xz.y);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "smartpointerhelp.h"
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Chunks are stored on disk in region files, each holding the 32 x 32
+// Chunks of one 512 x 512 block area of the x-z plane.
+#define REGION_CHUNKS 32
+
+// One region file. It begins with a header that has an entry for every
+// Chunk in the region, followed by the Chunks' encoded data in any order:
+//   uint32 magic, uint32 version,
+//   REGION_CHUNKS^2 x { uint32 offset, uint32 length, uint32 capacity }
+// An offset of 0 means the Chunk was never saved. A Chunk that is saved
+// again is written over its old data when it fits in the capacity.
+// When it doesn't, it goes to the first extent no entry uses that is
+// large enough, or is appended to the end of the file, and its old
+// extent becomes free. Integers are stored in the machine's native
+// byte order.
+// Reads go through a read-only memory mapping of the file where the
+// platform supports it. All methods are thread-safe.
+class RegionFile {
+private:
+    struct Entry {
+        uint32_t offset, length, capacity;
+    };
+
+    std::mutex m_mutex;
+    std::string m_path;
+    std::fstream m_file; // Used for writing, and reading when mmap is unavailable
+    std::array<Entry, REGION_CHUNKS * REGION_CHUNKS> m_header;
+    uint64_t m_fileSize;
+    // Offset to size of every range past the header that no entry's
+    // capacity covers, neighboring ranges merged. Found from the header
+    // when the file is opened.
+    std::map<uint32_t, uint32_t> m_freeExtents;
+
+    // Read-only mapping of the first m_mapSize bytes of the file
+    int m_fd;
+    unsigned char *mp_map;
+    uint64_t m_mapSize;
+
+    // Maps the whole file again once it has grown past the mapping
+    void remap();
+    void unmap();
+    void writeEntry(int index);
+    void findFreeExtents();
+    // Takes size bytes from the first free extent large enough, or the
+    // end of the file, and returns their offset
+    uint32_t allocateExtent(uint32_t size);
+    void freeExtent(uint32_t offset, uint32_t size);
+
+public:
+    // Opens the file at path, creating it if it doesn't exist
+    RegionFile(const std::string &path);
+    ~RegionFile();
+
+    // Was the file opened (or created) successfully?
+    bool isOpen() const;
+    // localX and localZ are the Chunk's index within the region, 0 to 31.
+    // Returns false if the Chunk is not in the file.
+    bool read(int localX, int localZ, std::vector<unsigned char> &out);
+    void write(int localX, int localZ, const std::vector<unsigned char> &data);
+};
+
+// Every region file of a world, in one directory.
+// Saves are asynchronous: queueWrite() keeps the data in memory until
+// writePending() puts it on disk, normally from a worker thread, and
+// read() returns queued data first so a Chunk reloaded before its write
+// lands still gets its latest blocks.
+// All methods are thread-safe.
+class RegionStore {
+private:
+    std::mutex m_mutex;
+    std::mutex m_writeMutex;
+    std::string m_directory; // Empty disables saving and loading
+    std::unordered_map<int64_t, uPtr<RegionFile>> m_regions;
+    std::unordered_map<int64_t, std::vector<unsigned char>> m_pending; // Keyed by Chunk
+
+    // Opens the region containing the Chunk whose corner is (x, z)
+    RegionFile* getRegion(int x, int z);
+
+public:
+    RegionStore();
+
+    // Creates the directory if needed. Call before any Chunk is loaded.
+    void setDirectory(const std::string &directory);
+    bool isEnabled();
+
+    // (x, z) is the world-space corner of the Chunk, as in Chunk::getMins()
+    bool read(int x, int z, std::vector<unsigned char> &out);
+    void queueWrite(int x, int z, std::vector<unsigned char> data);
+    // Writes the Chunk's queued data, if it still has any
+    void writePending(int x, int z);
+    // Writes everything still queued
+    void flush();
+};
@@ -1,47 +1,35 @@
 #include "terrain.h"
 #include "cube.h"
+#include "noise.h"
+#include "profiler.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <stdexcept>
 #include <iostream>
 
 Terrain::Terrain(OpenGLContext *context)
-    : m_chunks(), m_generatedTerrain(), m_geomCube(context), mp_context(context),
-      blocktype_threads(), vbo_threads(), block_mutex(), vbo_mutex(), chunk_vbos()
+    : m_arena(context), m_chunks(), m_generatedTerrain(), m_memoryBudget(TERRAIN_MEMORY_BUDGET), m_geomCube(context),
+      m_uploads(), m_visible(), m_culledLastFrame(0), m_opaqueDraws(), m_transDraws(), m_caveCuller(), m_occlusionCulling(true),
+      m_occludedLastFrame(0), m_occludedTrianglesLastFrame(0), mp_context(context), m_regions(), m_noise{NOISE_INTEGER_HASH, 0},
+      m_heightFields(), m_heightFieldsMutex(),
+      m_jobs(), m_scheduler(m_jobs)
 {}
 
 Terrain::~Terrain() {
-    m_geomCube.destroyVBOdata();
-}
-
-// Combine two 32-bit ints into one 64-bit int
-// where the upper 32 bits are X and the lower 32 bits are Z
-int64_t toKey(int x, int z) {
-    int64_t xz = 0xffffffffffffffff;
-    int64_t x64 = x;
-    int64_t z64 = z;
-
-    // Set all lower 32 bits to 1 so we can & with Z later
-    xz = (xz & (x64 << 32)) | 0x00000000ffffffff;
-
-    // Set all upper 32 bits to 1 so we can & with XZ
-    z64 = z64 | 0xffffffff00000000;
-
-    // Combine
-    xz = xz & z64;
-    return xz;
-}
-
-glm::ivec2 toCoords(int64_t k) {
-    // Z is lower 32 bits
-    int64_t z = k & 0x00000000ffffffff;
-    // If the most significant bit of Z is 1, then it's a negative number
-    // so we have to set all the upper 32 bits to 1.
-    // Note the 8    V
-    if(z & 0x0000000080000000) {
-        z = z | 0xffffffff00000000;
+    // Let in-flight jobs finish before the Chunks they point to go away
+    m_jobs.shutdown();
+    // Anything the workers didn't get to is written here instead
+    for (auto &[key, chunk] : m_chunks) {
+        if (chunk->hasBlocks() && chunk->blocks_dirty) {
+            glm::vec2 mins = chunk->getMins();
+            m_regions.queueWrite(mins.x, mins.y, chunk->encodeBlocks());
+        }
     }
-    int64_t x = (k >> 32);
-
-    return glm::ivec2(x, z);
+    m_regions.flush();
+    m_geomCube.destroyVBOdata();
+    m_chunks.clear();
+    m_arena.destroy();
 }
 
 // Surround calls to this with try-catch if you don't know whether
@@ -55,7 +43,15 @@ BlockType Terrain::getBlockAt(int x, int y, int z) const
             return EMPTY;
         }
         const uPtr<Chunk> &c = getChunkAt(x, z);
+        // A worker may still be filling it in
+        if (!c->hasBlocks()) {
+            return EMPTY;
+        }
         glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
+        // Everything above the column's top block is air
+        if (y >= c->columnHeight(x - chunkOrigin.x, z - chunkOrigin.y)) {
+            return EMPTY;
+        }
         return c->getBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
                              static_cast<unsigned int>(y),
                              static_cast<unsigned int>(z - chunkOrigin.y));
@@ -71,6 +67,19 @@ BlockType Terrain::getBlockAt(glm::vec3 p) const {
     return getBlockAt(p.x, p.y, p.z);
 }
 
+int Terrain::getColumnHeight(int x, int z) const {
+    if (!hasChunkAt(x, z)) {
+        return 0;
+    }
+    const uPtr<Chunk> &c = getChunkAt(x, z);
+    if (!c->hasBlocks()) {
+        return 0;
+    }
+    int lx = x - 16 * static_cast<int>(glm::floor(x / 16.f));
+    int lz = z - 16 * static_cast<int>(glm::floor(z / 16.f));
+    return c->columnHeight(lx, lz);
+}
+
 bool Terrain::hasChunkAt(int x, int z) const {
     // Map x and z to their nearest Chunk corner
     // By flooring x and z, then multiplying by 16,
@@ -103,10 +112,24 @@ void Terrain::setBlockAt(int x, int y, int z, BlockType t)
     if(hasChunkAt(x, z)) {
         uPtr<Chunk> &c = getChunkAt(x, z);
         glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        c->setBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
+        int localX = x - static_cast<int>(chunkOrigin.x);
+        int localZ = z - static_cast<int>(chunkOrigin.y);
+        c->setBlockAt(static_cast<unsigned int>(localX),
                       static_cast<unsigned int>(y),
-                      static_cast<unsigned int>(z - chunkOrigin.y),
+                      static_cast<unsigned int>(localZ),
                       t);
+        // A block on the Chunk's border also shows or hides a face of the
+        // block next to it in the neighboring Chunk
+        uint16_t section = 1 << (y >> 4);
+        const auto &neighbors = c->getNeighbors();
+        std::array<std::pair<bool, Direction>, 4> borders = {{{localX == 0, XNEG}, {localX == 15, XPOS},
+                                                              {localZ == 0, ZNEG}, {localZ == 15, ZPOS}}};
+        for (auto &[onBorder, dir] : borders) {
+            Chunk *neighbor = neighbors.at(dir);
+            if (onBorder && neighbor != nullptr) {
+                neighbor->markSectionsDirty(section);
+            }
+        }
     }
     else {
         throw std::out_of_range("Coordinates " + std::to_string(x) +
@@ -116,7 +139,7 @@ void Terrain::setBlockAt(int x, int y, int z, BlockType t)
 }
 
 Chunk* Terrain::instantiateChunkAt(int x, int z) {
-    uPtr<Chunk> chunk = mkU<Chunk>(x, z, mp_context);
+    uPtr<Chunk> chunk = mkU<Chunk>(x, z, mp_context, &m_arena);
     Chunk *cPtr = chunk.get();
     m_chunks[toKey(x, z)] = std::move(chunk);
     // Set the neighbor pointers of itself and its neighbors
@@ -139,41 +162,139 @@ Chunk* Terrain::instantiateChunkAt(int x, int z) {
     return cPtr;
 }
 
-// TODO: When you make Chunk inherit from Drawable, change this code so
-// it draws each Chunk with the given ShaderProgram, remembering to set the
-// model matrix to the proper X and Z translation!
-void Terrain::draw(ShaderProgram *shaderProgram, glm::vec3 pos) {
-    int xFloor = static_cast<int>(glm::floor(pos.x / 64.f));
-    int zFloor = static_cast<int>(glm::floor(pos.z / 64.f));
-    shaderProgram->setModelMatrix(glm::mat4());
-    for (int i = xFloor - DRAW_RADIUS; i < xFloor + DRAW_RADIUS + 1; i++) {
-        for (int j = zFloor - DRAW_RADIUS; j < zFloor + DRAW_RADIUS + 1; j++){
-            for (int k = i*64; k < (i+1)*64; k += 16) {
-                for (int l = j*64; l < (j+1)*64; l +=16) {
-                    if (hasChunkAt(k, l)){
-                        uPtr<Chunk> &c = getChunkAt(k, l);
-                        if (c->buffer_created){
-                            shaderProgram->draw(*(c.get()), false);
-                        }
-                    }
-                }
-            }
+// Adds a draw per range of the Chunk's sections in the sections mask to
+// the commands of its arena page, with neighboring sections merged into
+// one draw
+static void addSectionDraws(const Chunk &c, uint16_t sections, bool transparent,
+                            std::vector<MultiDrawCommands> &draws) {
+    MultiDrawCommands &out = draws[c.arenaPage()];
+    GLint baseVertex = c.arenaBaseVertex(transparent);
+    GLuint rangeFirst = 0, rangeCount = 0;
+    for (int s = 0; s < CHUNK_SECTIONS; s++) {
+        std::pair<GLuint, GLuint> range = c.sectionIndexRange(s, transparent);
+        if (range.second == 0 || !(sections & (1 << s))) {
+            continue;
         }
+        if (rangeCount > 0 && rangeFirst + rangeCount == range.first) {
+            rangeCount += range.second;
+            continue;
+        }
+        if (rangeCount > 0) {
+            out.add(rangeCount, rangeFirst, baseVertex);
+        }
+        rangeFirst = range.first;
+        rangeCount = range.second;
+    }
+    if (rangeCount > 0) {
+        out.add(rangeCount, rangeFirst, baseVertex);
     }
+}
+
+// Draws every uploaded Chunk within DRAW_RADIUS zones of pos whose mesh
+// is at least partly inside the camera's view, opaque geometry first and
+// then the transparent geometry over it. Of those, only the sections
+// m_caveCuller finds a see-through path to from pos are drawn.
+// Every visible section goes into the command list of its arena page, so
+// each pass is one draw call per page however many Chunks are visible.
+void Terrain::draw(ShaderProgram *shaderProgram, glm::vec3 eye, const glm::mat4 &viewProj) {
+    PROFILE_SCOPE("Terrain::draw");
+    Frustum frustum(viewProj);
+    int xFloor = static_cast<int>(glm::floor(eye.x / 64.f));
+    int zFloor = static_cast<int>(glm::floor(eye.z / 64.f));
+    shaderProgram->setModelMatrix(glm::mat4());
+    if (m_occlusionCulling) {
+        m_caveCuller.update(*this, eye, frustum, (xFloor - DRAW_RADIUS) * 64, (zFloor - DRAW_RADIUS) * 64,
+                            (2 * DRAW_RADIUS + 1) * 4);
+    }
+    m_visible.clear();
+    m_culledLastFrame = 0;
+    m_occludedLastFrame = 0;
+    m_occludedTrianglesLastFrame = 0;
     for (int i = xFloor - DRAW_RADIUS; i < xFloor + DRAW_RADIUS + 1; i++) {
         for (int j = zFloor - DRAW_RADIUS; j < zFloor + DRAW_RADIUS + 1; j++){
             for (int k = i*64; k < (i+1)*64; k += 16) {
                 for (int l = j*64; l < (j+1)*64; l +=16) {
-                    if (hasChunkAt(k, l)){
-                        uPtr<Chunk> &c = getChunkAt(k, l);
-                        if (c->buffer_created){
-                            shaderProgram->draw(*(c.get()), true);
+                    if (!hasChunkAt(k, l)) {
+                        continue;
+                    }
+                    Chunk *c = getChunkAt(k, l).get();
+                    if (!c->hasGpuMesh() || c->elemCount(false) + c->elemCount(true) == 0) {
+                        continue;
+                    }
+                    if (!frustum.intersects(c->getBounds())) {
+                        m_culledLastFrame++;
+                        continue;
+                    }
+                    uint16_t sections = m_occlusionCulling ? m_caveCuller.visibleSections(k, l) : 0xFFFF;
+                    bool anyVisible = false;
+                    for (int s = 0; s < CHUNK_SECTIONS; s++) {
+                        GLuint count = c->sectionIndexRange(s, false).second + c->sectionIndexRange(s, true).second;
+                        if (sections & (1 << s)) {
+                            anyVisible |= count > 0;
+                        } else {
+                            m_occludedTrianglesLastFrame += count / 3;
                         }
                     }
+                    if (anyVisible) {
+                        m_visible.emplace_back(c, sections);
+                    } else {
+                        m_occludedLastFrame++;
+                    }
                 }
             }
         }
     }
+
+    int pages = m_arena.pageCount();
+    m_opaqueDraws.resize(pages);
+    m_transDraws.resize(pages);
+    for (int p = 0; p < pages; p++) {
+        m_opaqueDraws[p].clear();
+        m_transDraws[p].clear();
+    }
+    for (auto &[c, sections] : m_visible) {
+        addSectionDraws(*c, sections, false, m_opaqueDraws);
+        addSectionDraws(*c, sections, true, m_transDraws);
+    }
+    for (int p = 0; p < pages; p++) {
+        shaderProgram->drawMulti(m_arena.vertexBuffer(p), m_opaqueDraws[p]);
+    }
+    for (int p = 0; p < pages; p++) {
+        shaderProgram->drawMulti(m_arena.vertexBuffer(p), m_transDraws[p]);
+    }
+    mp_context->printGLErrorLog();
+}
+
+size_t Terrain::drawnChunkCount() const {
+    return m_visible.size();
+}
+
+size_t Terrain::culledChunkCount() const {
+    return m_culledLastFrame;
+}
+
+size_t Terrain::occludedChunkCount() const {
+    return m_occludedLastFrame;
+}
+
+size_t Terrain::occludedTriangleCount() const {
+    return m_occludedTrianglesLastFrame;
+}
+
+size_t Terrain::drawCallCount() const {
+    size_t calls = 0;
+    for (size_t p = 0; p < m_opaqueDraws.size(); p++) {
+        calls += !m_opaqueDraws[p].empty() + !m_transDraws[p].empty();
+    }
+    return calls;
+}
+
+void Terrain::setOcclusionCulling(bool enabled) {
+    m_occlusionCulling = enabled;
+}
+
+bool Terrain::occlusionCulling() const {
+    return m_occlusionCulling;
 }
 
 
@@ -215,179 +336,139 @@ void Terrain::CreateTestScene()
     for(int y = 129; y < 140; ++y) {
         setBlockAt(32, y, 32, GRASS);
     }
+    for (auto &[key, chunk] : m_chunks) {
+        chunk->setState(GENERATED);
+    }
 
 //    for (const auto &[key, chunk] : m_chunks) {
 //        chunk->createVBOdata();
 //    }
 }
 
-//////// Noise functions //////////////////////////////////////
-
-float random1( glm::vec2 p ) {
-    return glm::fract(glm::sin(glm::dot(p,glm::vec2(127.1,311.7)))*43758.5453f);
-}
-
-float mySmootherStep(float a, float b, float t) {
-    t = t*t*t*(t*(t*6.0 - 15.0) + 10.0);
-    return glm::mix(a, b, t);
-}
-
-float bilerpNoise(glm::vec2 uv) {
-    glm::vec2 uvFract = glm::fract(uv);
-    float ll = random1(glm::floor(uv));
-    float lr = random1(glm::floor(uv) + glm::vec2(1,0));
-    float ul = random1(glm::floor(uv) + glm::vec2(0,1));
-    float ur = random1(glm::floor(uv) + glm::vec2(1,1));
-
-    float lerpXL = mySmootherStep(ll, lr, uvFract.x);
-    float lerpXU = mySmootherStep(ul, ur, uvFract.x);
+void Terrain::generateBlocks(Chunk* c) {
+    PROFILE_SCOPE("Terrain::generateBlocks");
+    glm::vec2 mins = c->getMins();
+    // All the noise for the Chunk, several columns at a time
+    int minX = static_cast<int>(mins.x), minZ = static_cast<int>(mins.y);
+    sPtr<const HeightField> field = getHeightField(minX, minZ);
+    ChunkHeightmap heightmap;
+    computeHeightmap(minX, minZ, m_noise, *field, heightmap);
+    for(int x = 0; x < 16; x++) {
+        for(int z = 0; z < 16; z++) {
+            float mountain = heightmap.mountain[x + 16 * z];
+            float lerp = heightmap.biome[x + 16 * z];
+            float y_final = heightmap.height[x + 16 * z];
+            // The surface block; everything from 128 up to it is filled
+            int top = static_cast<int>(y_final);
 
-    return mySmootherStep(lerpXL, lerpXU, uvFract.y);
-}
+            c->fillColumn(x, z, 128, 129, STONE);
+            if (lerp < 0.45) {
+                // grass
+                c->fillColumn(x, z, 129, top, DIRT);
+                c->fillColumn(x, z, top, top + 1, GRASS);
+            } else if (mountain <= 180) {
+                // moutain
+                c->fillColumn(x, z, 129, top + 1, STONE);
+            } else {
+                // moutain, with SNOW on top
+                c->fillColumn(x, z, 129, top, STONE);
+                c->fillColumn(x, z, top, top + 1, SNOW);
+            }
 
-float fbm(glm::vec2 uv) {
-    float amp = 0.5;
-    float freq = 8.0;
-    float sum = 0.0;
-    for(int i = 0; i < 6; i++) {
-        sum += bilerpNoise(uv * freq) * amp;
-        amp *= 0.5;
-        freq *= 2.0;
+            // Fill the EMPTY blocks between heights 128 and 142 with WATER
+            c->fillColumn(x, z, top + 1, 143, WATER);
+        }
     }
-    return sum;
-}
-
-glm::vec2 random2( glm::vec2 p ) {
-    return glm::fract(glm::sin(glm::vec2(glm::dot(p,glm::vec2(127.1,311.7)),glm::dot(p,glm::vec2(269.5,183.3))))*43758.5453f);
+    // Sections were filled one run at a time, so their palettes may still
+    // hold types that were overwritten, e.g. EMPTY below the surface
+    c->compactBlocks();
+    // The fills above mark the blocks as edited, but freshly generated
+    // blocks can be generated again and needn't be saved
+    c->blocks_dirty = false;
+    c->setState(GENERATED);
 }
 
-float surflet(glm::vec2 P, glm::vec2 gridPoint) {
-    // Compute falloff function by converting linear distance to a polynomial (quintic smootherstep function)
-    float distX = abs(P.x - gridPoint.x);
-    float distY = abs(P.y - gridPoint.y);
-    float tX = 1.0 - 6.0 * pow(distX, 5.0) + 15.0 * pow(distX, 4.0) - 10.0 * pow(distX, 3.0);
-    float tY = 1.0 - 6.0 * pow(distY, 5.0) + 15.0 * pow(distY, 4.0) - 10.0 * pow(distY, 3.0);
-
-    // Get the random vector for the grid point
-    glm::vec2 gradient = random2(gridPoint);
-    // Get the vector from the grid point to P
-    glm::vec2 diff = P - gridPoint;
-    // Get the value of our height field by dotting grid->P with our gradient
-    float height = glm::dot(diff, gradient);
-    // Scale our height field (i.e. reduce it) by our polynomial falloff function
-    return height * tX * tY;
+sPtr<const HeightField> Terrain::getHeightField(int x, int z) {
+    int zoneX = static_cast<int>(glm::floor(x / 64.f));
+    int zoneZ = static_cast<int>(glm::floor(z / 64.f));
+    int64_t key = toKey(zoneX, zoneZ);
+    {
+        std::lock_guard<std::mutex> lock(m_heightFieldsMutex);
+        auto it = m_heightFields.find(key);
+        if (it != m_heightFields.end()) {
+            return it->second;
+        }
+    }
+    // Computed without the lock, so workers in other zones aren't held
+    // up. If two workers race here, the first one's field is kept.
+    sPtr<HeightField> field = mkS<HeightField>();
+    computeHeightField(zoneX * 64, zoneZ * 64, m_noise, *field);
+    std::lock_guard<std::mutex> lock(m_heightFieldsMutex);
+    return m_heightFields.emplace(key, std::move(field)).first->second;
 }
 
-float PerlinNoise(glm::vec2 uv) {
-    // Tile the space
-    glm::vec2 uvXLYL = glm::floor(uv);
-    glm::vec2 uvXHYL = uvXLYL + glm::vec2(1,0);
-    glm::vec2 uvXHYH = uvXLYL + glm::vec2(1,1);
-    glm::vec2 uvXLYH = uvXLYL + glm::vec2(0,1);
-
-    return surflet(uv, uvXLYL) + surflet(uv, uvXHYL) + surflet(uv, uvXHYH) + surflet(uv, uvXLYH);
+void Terrain::loadBlocks(Chunk *c) {
+    PROFILE_SCOPE("Terrain::loadBlocks");
+    glm::vec2 mins = c->getMins();
+    std::vector<unsigned char> data;
+    if (m_regions.read(mins.x, mins.y, data) && c->decodeBlocks(data)) {
+        c->blocks_dirty = false;
+        c->setState(GENERATED);
+        return;
+    }
+    generateBlocks(c);
 }
 
-
-float fractalNoise(glm::vec2 uv, float o, float l, float p, float s) {
-    float value = 0.;
-    float amp = 2;
-    float x1 = uv.x;
-    float z1 = uv.y;
-    for (int i = 0; i < o; i++) {
-        value += abs(PerlinNoise(glm::vec2(x1, z1) / s)) * amp;
-        x1 *= l;
-        z1 *= l;
-        amp *= p;
+void Terrain::saveChunk(Chunk *c) {
+    if (!c->hasBlocks() || !c->blocks_dirty) {
+        return;
     }
-    value = pow(value, 2);
-    return glm::clamp(value, -1.f, 1.f);
+    glm::vec2 mins = c->getMins();
+    int x = static_cast<int>(mins.x);
+    int z = static_cast<int>(mins.y);
+    m_regions.queueWrite(x, z, c->encodeBlocks());
+    c->blocks_dirty = false;
+    m_jobs.submit([this, x, z]() { m_regions.writePending(x, z); });
 }
 
-float WorleyNoise(glm::vec2 uv) {
-
-    // Tile the space
-    glm::vec2 uvInt = glm::floor(uv);
-    glm::vec2 uvFract = glm::fract(uv);
-    float minDist = 1.0; // Minimum distance initialized to max.
-
-    // Search all neighboring cells and this cell for their point
-    for(int y = -1; y <= 1; y++) {
-        for(int x = -1; x <= 1; x++) {
-            glm::vec2 neighbor = glm::vec2(float(x), float(y));
-
-            // Random point inside current neighboring cell
-            glm::vec2 point = random2(uvInt + neighbor);
-
-            // Animate the point
-//            point = 0.5 + 0.5 * sin(u_Time * 0.01 + 6.2831 * point); // 0 to 1 range
+// world.dat: uint32 magic, uint32 version, uint32 backend, uint32 seed,
+// in the machine's native byte order like the region files
+static const uint32_t WORLD_MAGIC = 0x444c524d; // "MRLD"
+static const uint32_t WORLD_VERSION = 1;
 
-            // Compute the distance b/t the point and the fragment
-            // Store the min dist thus far
-            glm::vec2 diff = neighbor + point - uvFract;
-            float dist = glm::length(diff);
-            minDist = glm::min(minDist, dist);
+void Terrain::setSaveDirectory(const std::string &directory) {
+    m_regions.setDirectory(directory);
+    if (!m_regions.isEnabled()) {
+        return;
+    }
+    std::string path = directory + "/world.dat";
+    std::array<uint32_t, 4> header;
+    std::ifstream in(path, std::ios::binary);
+    if (in.read(reinterpret_cast<char*>(header.data()), sizeof(header)) &&
+            header[0] == WORLD_MAGIC && header[1] == WORLD_VERSION && header[2] <= NOISE_INTEGER_HASH) {
+        m_noise = NoiseSettings{static_cast<NoiseBackend>(header[2]), header[3]};
+        return;
+    }
+    in.close();
+    // Worlds saved before world.dat existed were all generated with sin-fract noise
+    std::error_code err;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, err)) {
+        if (entry.path().extension() == ".region") {
+            m_noise = NoiseSettings{NOISE_SIN_FRACT, 0};
+            break;
         }
     }
-    return minDist;
+    header = {WORLD_MAGIC, WORLD_VERSION, m_noise.backend, m_noise.seed};
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(header.data()), sizeof(header));
 }
 
-/////////////////////////////////////////////////////////////////////
-
-void Terrain::generateBlocks(int minX, int minZ, std::mutex& mu) {
-    mu.lock();
-    Chunk* c = instantiateChunkAt(minX, minZ);
-    mu.unlock();
-    for(int x = 0; x < 16; x++) {
-        for(int z = 0; z < 16; z++) {
-            int truex = minX + x;
-            int truez = minZ + z;
-            glm::vec2 xz = glm::vec2(float(truex), float(truez));
-            float mountain = glm::floor((150.f + glm::abs(fractalNoise(xz, 5, 3, 0.2, 80)) * 200));
-            glm::vec2 offset = glm::vec2(fbm(xz / 256.f), fbm(xz / 128.f)) + glm::vec2(1000.f);
-            float grass =  128 + (1. - WorleyNoise((xz + offset * 50.f) / 70.f)) * 30.f;
-            float lerp =  0.5 * (PerlinNoise(xz / 200.f) + 1.f);
-            lerp = glm::smoothstep(0.4, 0.6, (double)lerp);
-            float y_final = glm::mix(grass, mountain, lerp);
-            y_final = glm::min(y_final, 255.f);
-
-            if (lerp < 0.45) {
-                // grass
-                for (int y = 128; y <= 128; y++) {
-                    c->setBlockAt(x, y, z, STONE);
-                }
-                for (int y = 129; y < y_final; y++) {
-                    c->setBlockAt(x, y, z, DIRT);
-                }
-                c->setBlockAt(x, y_final, z, GRASS);
-            } else {
-                // moutain
-                for (int y = 128; y <= 128; y++) {
-                    c->setBlockAt(x, y, z, STONE);
-                }
-                if (mountain <= 180) {
-                    // Fill above y's with STONE blocks
-                    for (int y = 129; y <= y_final; y++) {
-                        c->setBlockAt(x, y, z, STONE);
-                    }
-                } else {
-                    // Fill above y's with STONE blocks except top
-                    for (int y = 129; y < y_final; y++) {
-                        c->setBlockAt(x, y, z, STONE);
-                    }
-                    // Fill top y with SNOW blocks
-                    c->setBlockAt(x, y_final, z, SNOW);
-                }
-            }
+void Terrain::setNoiseSettings(const NoiseSettings &settings) {
+    m_noise = settings;
+}
 
-            // Fill any EMPTY blocks between height of [128, 138] with WATER
-            for (int y = 128; y <= 142; ++y) {
-                if (c->getBlockAt(x, y, z) == EMPTY) {
-                    c->setBlockAt(x, y, z, WATER);
-                }
-            }
-        }
-    }
+const NoiseSettings& Terrain::getNoiseSettings() const {
+    return m_noise;
 }
 
 void Terrain::CreateNewScene() {
@@ -406,43 +487,246 @@ void Terrain::CreateNewScene() {
 //    generateBlocks(0, 0);
 }
 
-void Terrain::checkTerrain(glm::vec3 pos) {
+void Terrain::queueMesh(Chunk *c) {
+    c->setState(MESHING);
+    m_scheduler.request(c, ChunkScheduler::MESH,
+                        [this, c]() { c->generateVBO(m_uploads); },
+                        [c]() { c->setState(MESHABLE); });
+}
+
+void Terrain::advanceChunk(Chunk *c) {
+    switch (c->getState()) {
+    case REQUESTED:
+        // Also requeues a generation the scheduler cancelled when the
+        // player left. Does nothing while one is pending.
+        m_scheduler.request(c, ChunkScheduler::GENERATE, [this, c]() { loadBlocks(c); });
+        break;
+    case GENERATED:
+        // A neighbor only has a mesh already if it was meshed before this
+        // Chunk's zone was unloaded, and then its border faces have to be
+        // rebuilt. Done once, as the Chunk leaves GENERATED.
+        for (Chunk *neighbor : c->getNeighbors()) {
+            if (neighbor != nullptr) {
+                neighbor->invalidateMesh();
+            }
+        }
+        c->setState(WAITING);
+        [[fallthrough]];
+    case WAITING:
+    case EVICTABLE:
+        // Meshing before the neighbors exist would show every face on the
+        // borders, only to mesh again once they do
+        if (!c->neighborsHaveBlocks()) {
+            break;
+        }
+        c->setState(MESHABLE);
+        queueMesh(c);
+        break;
+    case MESHABLE:
+        queueMesh(c);
+        break;
+    case UPLOADED:
+        // An edit, or a neighbor loaded again after being unloaded,
+        // touched some sections
+        if (c->hasDirtySections() && c->neighborsHaveBlocks()) {
+            c->setState(MESHABLE);
+            queueMesh(c);
+        }
+        break;
+    case MESHING:
+    case MESHED:
+        // One mesh at a time; edits made meanwhile leave their sections
+        // dirty, and are picked up once it is uploaded
+        break;
+    }
+}
+
+void Terrain::checkTerrain(glm::vec3 pos, glm::vec3 forward) {
+    PROFILE_SCOPE("Terrain::checkTerrain");
     int xFloor = static_cast<int>(glm::floor(pos.x / 64.f));
     int zFloor = static_cast<int>(glm::floor(pos.z / 64.f));
     for (int i = xFloor - TERRAIN_RADIUS; i < xFloor + TERRAIN_RADIUS + 1; i++) {
         for (int j = zFloor - TERRAIN_RADIUS; j < zFloor + TERRAIN_RADIUS + 1; j++) {
             if (m_generatedTerrain.find(toKey(i, j)) == m_generatedTerrain.end()) {
                 m_generatedTerrain.insert(toKey(i, j));
-                // create chunks
+                // create chunks here so m_chunks is only ever modified on this
+                // thread, then fill them in the background
                 for (int k = i*64; k < (i+1)*64; k += 16) {
                     for (int l = j*64; l < (j+1)*64; l +=16) {
-                        blocktype_threads.push_back(std::thread(&Terrain::generateBlocks, this, k, l, std::ref(block_mutex)));
+                        instantiateChunkAt(k, l);
                     }
                 }
-            } else {
-                for (int k = i*64; k < (i+1)*64; k += 16) {
-                    for (int l = j*64; l < (j+1)*64; l +=16) {
-                        if (hasChunkAt(k, l)) {
-                            uPtr<Chunk> &c = getChunkAt(k, l);
-                            if (!c->vbo_created) {
-                                vbo_threads.push_back(std::thread(&Chunk::generateVBO, c.get(),
-                                                                  std::ref(chunk_vbos), std::ref(vbo_mutex)));
-                                c->vbo_created = true;
-                            }
-                        }
+            }
+            // The scheduler decides what actually runs first. Anything it
+            // cancelled for leaving the radius gets queued again here once
+            // the player comes back.
+            for (int k = i*64; k < (i+1)*64; k += 16) {
+                for (int l = j*64; l < (j+1)*64; l +=16) {
+                    if (!hasChunkAt(k, l)) {
+                        continue;
                     }
+                    advanceChunk(getChunkAt(k, l).get());
                 }
             }
         }
     }
-    vbo_mutex.lock();
-    for (auto const& c:chunk_vbos) {
-        c.chunk->bindBuffer(c.d, c.d_trans, c.idx, c.idx_trans);
+    m_scheduler.update(pos, forward, TERRAIN_RADIUS);
+
+    m_uploads.upload(pos);
+
+    m_scheduler.trackVisibility(hasChunkAt(pos.x, pos.z) && getChunkAt(pos.x, pos.z)->hasGpuMesh());
+
+    evictChunks(pos);
+}
+
+const ChunkScheduler& Terrain::getScheduler() const {
+    return m_scheduler;
+}
+
+const ChunkUploadQueue& Terrain::getUploadQueue() const {
+    return m_uploads;
+}
 
+const JobSystem& Terrain::getJobSystem() const {
+    return m_jobs;
+}
+
+size_t Terrain::chunkCount() const {
+    return m_chunks.size();
+}
+
+size_t Terrain::uploadedChunkCount() const {
+    size_t count = 0;
+    for (auto &[key, chunk] : m_chunks) {
+        count += chunk->hasGpuMesh();
     }
-    chunk_vbos.clear();
-    vbo_mutex.unlock();
+    return count;
+}
+
+const ChunkArena& Terrain::getArena() const {
+    return m_arena;
+}
+
+void Terrain::setUploadBudget(size_t maxBytes, size_t maxChunks) {
+    m_uploads.setBudget(maxBytes, maxChunks);
+}
 
+void Terrain::setMemoryBudget(size_t maxBytes) {
+    m_memoryBudget = maxBytes;
+}
 
+size_t Terrain::memoryUsage() const {
+    // The arena's pages, rather than the Chunks' ranges of them, since a
+    // released range frees no VRAM until its whole page is empty
+    size_t bytes = m_arena.capacityBytes();
+    for (auto &[key, chunk] : m_chunks) {
+        bytes += sizeof(Chunk) + chunk->blockBytes() + chunk->meshBytes();
+    }
+    std::lock_guard<std::mutex> lock(m_heightFieldsMutex);
+    return bytes + m_heightFields.size() * sizeof(HeightField);
+}
 
+bool Terrain::canEvict(const Chunk *c) const {
+    if (m_scheduler.isScheduled(c, ChunkScheduler::GENERATE) ||
+        m_scheduler.isScheduled(c, ChunkScheduler::MESH)) {
+        return false;
+    }
+    for (Chunk *neighbor : c->getNeighbors()) {
+        if (neighbor != nullptr && m_scheduler.isScheduled(neighbor, ChunkScheduler::MESH)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Terrain::unloadZone(int64_t zoneKey) {
+    glm::ivec2 zone = toCoords(zoneKey);
+    for (int k = zone.x*64; k < (zone.x+1)*64; k += 16) {
+        for (int l = zone.y*64; l < (zone.y+1)*64; l += 16) {
+            if (hasChunkAt(k, l) && !canEvict(getChunkAt(k, l).get())) {
+                return false;
+            }
+        }
+    }
+    for (int k = zone.x*64; k < (zone.x+1)*64; k += 16) {
+        for (int l = zone.y*64; l < (zone.y+1)*64; l += 16) {
+            auto it = m_chunks.find(toKey(k, l));
+            if (it == m_chunks.end()) {
+                continue;
+            }
+            Chunk *c = it->second.get();
+            saveChunk(c);
+            m_uploads.discard(c);
+            c->unlinkNeighbors();
+            m_chunks.erase(it);
+        }
+    }
+    m_arena.trim();
+    m_generatedTerrain.erase(zoneKey);
+    std::lock_guard<std::mutex> lock(m_heightFieldsMutex);
+    m_heightFields.erase(zoneKey);
+    return true;
+}
+
+void Terrain::evictChunks(glm::vec3 pos) {
+    PROFILE_SCOPE("Terrain::evictChunks");
+    int xFloor = static_cast<int>(glm::floor(pos.x / 64.f));
+    int zFloor = static_cast<int>(glm::floor(pos.z / 64.f));
+    // Nothing but the zones the player needs is loaded
+    int side = 2 * TERRAIN_RADIUS + 1;
+    if (m_generatedTerrain.size() <= static_cast<size_t>(side * side)) {
+        return;
+    }
+    size_t usage = memoryUsage();
+    if (usage <= m_memoryBudget) {
+        return;
+    }
+
+    std::vector<std::pair<int, int64_t>> farZones;
+    for (int64_t key : m_generatedTerrain) {
+        glm::ivec2 zone = toCoords(key);
+        int dist = glm::max(glm::abs(zone.x - xFloor), glm::abs(zone.y - zFloor));
+        if (dist > TERRAIN_RADIUS) {
+            farZones.emplace_back(dist, key);
+        }
+    }
+    std::sort(farZones.begin(), farZones.end(), std::greater<std::pair<int, int64_t>>());
+
+    // Meshes are cheap to rebuild from the blocks, so they go first
+    for (auto &[dist, key] : farZones) {
+        if (usage <= m_memoryBudget) {
+            return;
+        }
+        glm::ivec2 zone = toCoords(key);
+        for (int k = zone.x*64; k < (zone.x+1)*64; k += 16) {
+            for (int l = zone.y*64; l < (zone.y+1)*64; l += 16) {
+                if (!hasChunkAt(k, l)) {
+                    continue;
+                }
+                Chunk *c = getChunkAt(k, l).get();
+                if (c->getState() == UPLOADED) {
+                    usage -= c->meshBytes();
+                    c->releaseVBOdata();
+                    c->setState(EVICTABLE);
+                }
+            }
+        }
+        size_t capacity = m_arena.capacityBytes();
+        m_arena.trim();
+        usage -= capacity - m_arena.capacityBytes();
+    }
+    for (auto &[dist, key] : farZones) {
+        if (usage <= m_memoryBudget) {
+            return;
+        }
+        if (unloadZone(key)) {
+            usage = memoryUsage();
+        }
+    }
+}
+
+void Terrain::remeshAll() {
+    for (auto &[key, chunk] : m_chunks) {
+        chunk->invalidateMesh();
+    }
 }
@@ -7,26 +7,36 @@
 #include <unordered_set>
 #include "shaderprogram.h"
 #include "cube.h"
+#include "jobsystem.h"
+#include "chunkscheduler.h"
+#include "chunkuploadqueue.h"
+#include "regionfile.h"
+#include "chunkkey.h"
+#include "noise.h"
+#include "frustum.h"
+#include "caveculler.h"
 
 #include <thread>
 #include <mutex>
 
 #define TERRAIN_RADIUS 6
 #define DRAW_RADIUS 5
+// Default cap on block data plus chunk meshes before far zones are unloaded
+#define TERRAIN_MEMORY_BUDGET (384 << 20)
 
 
 //using namespace std;
 
-// Helper functions to convert (x, z) to and from hash map key
-int64_t toKey(int x, int z);
-glm::ivec2 toCoords(int64_t k);
-
 // The container class for all of the Chunks in the game.
 // Ultimately, while Terrain will always store all Chunks,
 // not all Chunks will be drawn at any given time as the world
 // expands.
 class Terrain {
 private:
+    // The GPU buffers every Chunk's mesh is uploaded into. Declared before
+    // the Chunks, which hand their space back when deleted.
+    ChunkArena m_arena;
+
     // Stores every Chunk according to the location of its lower-left corner
     // in world space.
     // We combine the X and Z coordinates of the Chunk's corner into one 64-bit int
@@ -44,10 +54,11 @@ private:
     // one 64 x 64 area with its lower-left corner at (0, 0).
     // When milestone 1 has been implemented, the Player can move around the
     // world to add more "terrain generation zone" IDs to this set.
-    // While only the 3 x 3 collection of terrain generation zones
-    // surrounding the Player should be rendered, the Chunks
-    // in the Terrain will never be deleted until the program is terminated.
+    // Once the Terrain uses more than m_memoryBudget bytes, zones outside
+    // TERRAIN_RADIUS are unloaded, farthest first, and removed from this set
+    // so they are generated again if the player comes back.
     std::unordered_set<int64_t> m_generatedTerrain;
+    size_t m_memoryBudget;
 
     // TODO: DELETE ALL REFERENCES TO m_geomCube AS YOU WILL NOT USE
     // IT IN YOUR FINAL PROGRAM!
@@ -58,17 +69,60 @@ private:
     // milestone 1's Chunk VBO setup is completed.
     Cube m_geomCube;
 
-    // Threads
-    std::vector<std::thread> blocktype_threads;
-    std::vector<std::thread> vbo_threads;
-    std::mutex block_mutex;
-    std::mutex vbo_mutex;
-
-    std::vector<ChunkVBOData> chunk_vbos;
+    // Meshes built by the workers, uploaded a few per frame
+    ChunkUploadQueue m_uploads;
+
+    // The Chunks the last draw() drew, with the sections it drew of each,
+    // and how many it skipped as outside the view frustum. Kept between
+    // frames so the vector isn't reallocated.
+    std::vector<std::pair<Chunk*, uint16_t>> m_visible;
+    size_t m_culledLastFrame;
+    // The visible sections' draws, per arena page, for the opaque and the
+    // transparent pass. Also kept between frames.
+    std::vector<MultiDrawCommands> m_opaqueDraws;
+    std::vector<MultiDrawCommands> m_transDraws;
+    // Finds the sections inside the frustum that solid terrain hides
+    CaveCuller m_caveCuller;
+    bool m_occlusionCulling;
+    // Chunks in the frustum with no visible section, and the triangles of
+    // every hidden section, in the last draw()
+    size_t m_occludedLastFrame;
+    size_t m_occludedTrianglesLastFrame;
 
 
     OpenGLContext* mp_context;
 
+    // A Chunk can only be deleted once no job is queued or running that
+    // reads it, including meshing of its neighbors
+    bool canEvict(const Chunk *c) const;
+    // Deletes every Chunk in the zone, returns false if any is still in use
+    bool unloadZone(int64_t zoneKey);
+
+    // Chunks saved to disk, so edits survive unloading and restarts
+    RegionStore m_regions;
+    // The noise backend and seed the world is generated with. Saved in
+    // world.dat next to the region files, since a world has to keep them
+    // for newly generated Chunks to match the saved ones.
+    NoiseSettings m_noise;
+
+    // Moves the Chunk to the next stage of its ChunkState, queueing the
+    // generation or meshing task that gets it there
+    void advanceChunk(Chunk*);
+    // Moves a MESHABLE Chunk to MESHING and schedules its mesh
+    void queueMesh(Chunk*);
+
+    // The HeightField of every zone whose Chunks were generated, by zone
+    // key. Computed by the first worker to generate one of the zone's 16
+    // Chunks, shared by the rest, and dropped when the zone is unloaded.
+    std::unordered_map<int64_t, sPtr<const HeightField>> m_heightFields;
+    mutable std::mutex m_heightFieldsMutex;
+
+    // Runs block generation and meshing off the GUI thread. Declared after
+    // the Chunks so it is destroyed, and its workers joined, before them.
+    JobSystem m_jobs;
+    // Orders generation and meshing jobs by how soon the player will see them
+    ChunkScheduler m_scheduler;
+
 public:
     Terrain(OpenGLContext *context);
     ~Terrain();
@@ -90,22 +144,81 @@ public:
     // values) return the block stored at that point in space.
     BlockType getBlockAt(int x, int y, int z) const;
     BlockType getBlockAt(glm::vec3 p) const;
+    // One above the highest non-EMPTY block of the world-space column
+    // (x, z), or 0 if it is all EMPTY or not generated yet. O(1); reads
+    // no blocks.
+    int getColumnHeight(int x, int z) const;
     // Given a world-space coordinate (which may have negative
     // values) set the block at that point in space to the
     // given type.
+    // The sections whose faces the block affects, including ones in
+    // neighboring Chunks, are remeshed by the next checkTerrain.
     void setBlockAt(int x, int y, int z, BlockType t);
 
-    // Draws every Chunk that falls within the bounding box
-    // described by the min and max coords, using the provided
+    // Draws the Chunks within DRAW_RADIUS zones of eye that the camera at
+    // eye with this view-projection matrix can see, using the provided
     // ShaderProgram
-    void draw(ShaderProgram *shaderProgram, glm::vec3);
+    void draw(ShaderProgram *shaderProgram, glm::vec3 eye, const glm::mat4 &viewProj);
+    // Chunks the last draw() drew, and skipped as outside the view
+    size_t drawnChunkCount() const;
+    size_t culledChunkCount() const;
+    // Chunks, and triangles of sections, the last draw() skipped as hidden
+    // behind solid terrain
+    size_t occludedChunkCount() const;
+    size_t occludedTriangleCount() const;
+    // Draw calls the last draw() made, one per arena page and pass
+    size_t drawCallCount() const;
+    void setOcclusionCulling(bool enabled);
+    bool occlusionCulling() const;
 
     // Initializes the Chunks that store the 64 x 256 x 64 block scene you
     // see when the base code is run.
     void CreateTestScene();
     void CreateNewScene();
-    void generateBlocks(int, int, std::mutex&);
-    void checkTerrain(glm::vec3);
+    // Fills an instantiated Chunk with procedural terrain. Runs on a worker thread.
+    void generateBlocks(Chunk*);
+    // The HeightField of the zone containing the column (x, z), computing
+    // it if it doesn't exist yet. Thread-safe.
+    sPtr<const HeightField> getHeightField(int x, int z);
+    // Fills an instantiated Chunk from its region file, or with generateBlocks
+    // if it was never saved. Runs on a worker thread.
+    void loadBlocks(Chunk*);
+    // Queues the Chunk's blocks to be written to its region file in the
+    // background, if they changed since they were loaded or last saved
+    void saveChunk(Chunk*);
+    // Enables saving and loading Chunks in the given directory. Call
+    // before the first checkTerrain. A world saved there before keeps its
+    // own noise settings, which replace the current ones; a new world is
+    // created with the current ones.
+    void setSaveDirectory(const std::string &directory);
+    // Call before the first checkTerrain
+    void setNoiseSettings(const NoiseSettings &settings);
+    const NoiseSettings& getNoiseSettings() const;
+    // Creates the terrain zones around pos that don't exist yet and
+    // schedules block generation and meshing for them, closest to pos and
+    // most in line with the camera's forward vector first. Then uploads
+    // the nearest meshes the workers have finished, within the upload budget.
+    void checkTerrain(glm::vec3 pos, glm::vec3 forward);
+    const ChunkScheduler& getScheduler() const;
+    const ChunkUploadQueue& getUploadQueue() const;
+    const JobSystem& getJobSystem() const;
+    // Chunks in memory, and how many of them have a mesh on the GPU
+    size_t chunkCount() const;
+    size_t uploadedChunkCount() const;
+    const ChunkArena& getArena() const;
+    // Caps how much mesh data checkTerrain sends to the GPU per call
+    void setUploadBudget(size_t maxBytes, size_t maxChunks);
+    void setMemoryBudget(size_t maxBytes);
+    // Block data and CPU mesh data of every loaded Chunk, the arena's GPU
+    // pages, and the zones' HeightFields, in bytes
+    size_t memoryUsage() const;
+    // Brings memoryUsage() back under the budget using the zones outside
+    // TERRAIN_RADIUS of pos, farthest first. Meshes go first; if
+    // that isn't enough, whole zones are deleted.
+    void evictChunks(glm::vec3 pos);
+    // Throws away every Chunk's mesh so checkTerrain rebuilds it,
+    // e.g. after switching Chunk::greedyMeshing
+    void remeshAll();
 };
 
 
@@ -0,0 +1,42 @@
+#include "voxelvolume.h"
+
+void computeFaceMasks(const PaddedSection &blocks, SectionFaceMasks &out) {
+    // Bit y + 1 of each padded column is the block at y, for y from -1
+    // to 16. Columns are contiguous in PaddedSection, at 18 * column.
+    std::array<uint32_t, 18 * 18> solid, water;
+    for (int c = 0; c < 18 * 18; c++) {
+        const BlockType *column = &blocks[18 * c];
+        uint32_t s = 0, w = 0;
+        for (int y = 0; y < 18; y++) {
+            s |= uint32_t(column[y] != EMPTY && column[y] != WATER) << y;
+            w |= uint32_t(column[y] == WATER) << y;
+        }
+        solid[c] = s;
+        water[c] = w;
+    }
+    // Solid blocks show their faces against air and water. Water only
+    // shows its top, against air.
+    out.slices.fill(0);
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            int c = (x + 1) + 18 * (z + 1);
+            uint32_t s = solid[c], w = water[c];
+            uint32_t shows[6] = {
+                s & ~solid[c + 1],                              // XPOS
+                s & ~solid[c - 1],                              // XNEG
+                (s & ~(s >> 1)) | (w & ~((s | w) >> 1)),        // YPOS
+                s & ~(s << 1),                                  // YNEG
+                s & ~solid[c + 18],                             // ZPOS
+                s & ~solid[c - 18]                              // ZNEG
+            };
+            for (int f = 0; f < 6; f++) {
+                uint16_t visible = (shows[f] >> 1) & 0xFFFF;
+                out.visible[f][x + 16 * z] = visible;
+                if (visible != 0) {
+                    out.slices[f] |= (f == YPOS || f == YNEG) ? visible
+                                   : (f == XPOS || f == XNEG) ? (1 << x) : (1 << z);
+                }
+            }
+        }
+    }
+}
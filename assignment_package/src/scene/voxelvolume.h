@@ -0,0 +1,218 @@
+#pragma once
+#include "palettedblocks.h"
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// C++ 11 allows us to define the size of an enum. This lets us use only one byte
+// of memory to store our different block types. By default, the size of a C++ enum
+// is that of an int (so, usually four bytes). This *does* limit us to only 256 different
+// block types, but in the scope of this project we'll never get anywhere near that many.
+enum BlockType : unsigned char
+{
+    EMPTY, GRASS, DIRT, STONE, WATER, SNOW, LAVA, BEDROCK
+};
+
+// The six cardinal directions in 3D space
+enum Direction : unsigned char
+{
+    XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
+};
+
+// Indexed by Direction
+constexpr Direction oppositeDirection[6] = {XNEG, XPOS, YNEG, YPOS, ZNEG, ZPOS};
+
+// The corners of each Direction's face of a unit block, counter-clockwise
+// seen from outside. Shared by every mesher.
+constexpr int faceCorners[6][4][3] = {
+    {{1, 1, 0}, {1, 0, 0}, {1, 0, 1}, {1, 1, 1}}, // XPOS
+    {{0, 1, 1}, {0, 0, 1}, {0, 0, 0}, {0, 1, 0}}, // XNEG
+    {{1, 1, 0}, {1, 1, 1}, {0, 1, 1}, {0, 1, 0}}, // YPOS
+    {{1, 0, 1}, {1, 0, 0}, {0, 0, 0}, {0, 0, 1}}, // YNEG
+    {{1, 1, 1}, {1, 0, 1}, {0, 0, 1}, {0, 1, 1}}, // ZPOS
+    {{0, 1, 0}, {0, 0, 0}, {1, 0, 0}, {1, 1, 0}}  // ZNEG
+};
+
+// Lower-left corner of a tile in the 16 x 16 texture atlas
+struct AtlasTile {
+    int col, row;
+};
+
+// Indexed by BlockType. Terrain vertices carry only the BlockType, so
+// lambert.vert.glsl keeps a copy of these tables that must match.
+constexpr AtlasTile blockTiles[8] = {{7, 1}, {3, 15}, {3, 15}, {1, 15},
+                                     {13, 3}, {2, 11}, {13, 1}, {7, 1}};
+constexpr float blockColors[8][3] = {{1.f, 0.f, 1.f},
+                                     {95 / 255.f, 159 / 255.f, 53 / 255.f},
+                                     {121 / 255.f, 85 / 255.f, 58 / 255.f},
+                                     {0.5f, 0.5f, 0.5f},
+                                     {0.f, 0.f, 0.75f},
+                                     {1.f, 1.f, 1.f},
+                                     {207 / 255.f, 16 / 255.f, 32 / 255.f},
+                                     {1.f, 0.f, 1.f}};
+
+// Grass uses a different tile on its top and bottom faces
+constexpr AtlasTile blockTile(BlockType t, Direction dir) {
+    return t == GRASS && dir == YPOS ? AtlasTile{8, 13}
+         : t == GRASS && dir == YNEG ? AtlasTile{2, 15}
+         : blockTiles[t];
+}
+
+// One 16x16x16 section of a VoxelVolume plus a one-block border from
+// whatever surrounds it, so meshing reads every block from one flat array.
+// Indexed by paddedIndex(), with x, y and z local to the section.
+using PaddedSection = std::array<BlockType, 18 * 18 * 18>;
+
+// x, y and z may each be -1 or 16 to reach the border. Columns are
+// contiguous, starting at 18 * ((x + 1) + 18 * (z + 1)).
+constexpr int paddedIndex(int x, int y, int z) {
+    return (y + 1) + 18 * ((x + 1) + 18 * (z + 1));
+}
+
+// Which faces of a section's blocks show, found a whole column at a time
+// from bit masks of the padded section's solid and water blocks: bit y of
+// visible[dir][x + 16 * z] is set if the block at (x, y, z) shows its dir
+// face. Bit d of slices[dir] is set if any face in the d-th slice across
+// dir's axis shows.
+// Solid blocks show their faces against EMPTY and WATER; WATER shows only
+// its top, against EMPTY.
+struct SectionFaceMasks {
+    std::array<std::array<uint16_t, 16 * 16>, 6> visible;
+    std::array<uint16_t, 6> slices;
+};
+void computeFaceMasks(const PaddedSection&, SectionFaceMasks&);
+
+// Index of the lowest set bit; bits must not be 0
+inline int lowestBit(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(bits);
+#else
+    int i = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+constexpr bool isPowerOfTwo(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+constexpr int log2OfPowerOfTwo(int n) {
+    return n <= 1 ? 0 : 1 + log2OfPowerOfTwo(n >> 1);
+}
+
+// An SX x SY x SZ box of blocks, the storage both Chunk and Planet_Chunk
+// are built on. Every dimension is a power of two and a multiple of 16, so
+// all index math is shifts and masks the compiler folds per size.
+// get() and set() don't check their coordinates; the *Checked variants
+// throw std::out_of_range like std::array::at() for callers that take
+// coordinates from outside.
+template <int SX, int SY, int SZ>
+class VoxelVolume {
+public:
+    static constexpr int SIZE_X = SX, SIZE_Y = SY, SIZE_Z = SZ;
+    static constexpr int SHIFT_X = log2OfPowerOfTwo(SX);
+    static constexpr int SHIFT_Y = log2OfPowerOfTwo(SY);
+    static constexpr int SHIFT_Z = log2OfPowerOfTwo(SZ);
+    static constexpr int SECTIONS_X = SX >> 4, SECTIONS_Y = SY >> 4, SECTIONS_Z = SZ >> 4;
+    static constexpr int SECTION_COUNT = SECTIONS_X * SECTIONS_Y * SECTIONS_Z;
+    static_assert(isPowerOfTwo(SX) && isPowerOfTwo(SY) && isPowerOfTwo(SZ) &&
+                  SX >= 16 && SY >= 16 && SZ >= 16,
+                  "VoxelVolume dimensions must be powers of two of at least 16");
+
+private:
+    PalettedBlocks<BlockType, SX, SY, SZ> m_blocks;
+
+public:
+    explicit VoxelVolume(BlockType fill = EMPTY)
+        : m_blocks(fill)
+    {}
+
+    // One unsigned compare per axis: negative coordinates wrap to huge ones
+    static constexpr bool contains(int x, int y, int z) {
+        return (static_cast<unsigned int>(x) >> SHIFT_X) == 0 &&
+               (static_cast<unsigned int>(y) >> SHIFT_Y) == 0 &&
+               (static_cast<unsigned int>(z) >> SHIFT_Z) == 0;
+    }
+    static void checkIndex(int x, int y, int z) {
+        if (!contains(x, y, z)) {
+            throw std::out_of_range("Block " + std::to_string(x) + " " + std::to_string(y) + " " +
+                                    std::to_string(z) + " is outside the " + std::to_string(SX) + "x" +
+                                    std::to_string(SY) + "x" + std::to_string(SZ) + " volume");
+        }
+    }
+
+    BlockType get(int x, int y, int z) const {
+        return m_blocks.get(x, y, z);
+    }
+    BlockType getChecked(int x, int y, int z) const {
+        checkIndex(x, y, z);
+        return m_blocks.get(x, y, z);
+    }
+    void set(int x, int y, int z, BlockType t) {
+        m_blocks.set(x, y, z, t);
+    }
+    void setChecked(int x, int y, int z, BlockType t) {
+        checkIndex(x, y, z);
+        m_blocks.set(x, y, z, t);
+    }
+    // Sets the blocks from yStart up to, but not including, yEnd in the
+    // column (x, z)
+    void fillColumn(int x, int z, int yStart, int yEnd, BlockType t) {
+        m_blocks.fillColumn(x, z, yStart, yEnd, t);
+    }
+    // Shrinks every section's palette to the types it still uses
+    void compact() {
+        m_blocks.compact();
+    }
+
+    using Section = typename PalettedBlocks<BlockType, SX, SY, SZ>::Section;
+    const Section& section(int sx, int sy, int sz) const {
+        return m_blocks.section(sx, sy, sz);
+    }
+    // Section holding block (x, y, z)
+    const Section& sectionAt(int x, int y, int z) const {
+        return m_blocks.sectionAt(x, y, z);
+    }
+    size_t memoryUsage() const {
+        return m_blocks.memoryUsage();
+    }
+
+    // Fills out with section (sx, sy, sz) and its one-block border.
+    // Border blocks inside the volume are read from it; the rest come from
+    // outside(x, y, z), called with volume-local coordinates just past an
+    // edge. Only blocks of column (x, z) below columnTop(x, z) are read,
+    // everything above counting as EMPTY, so callers that track column
+    // heights skip the air.
+    template <typename Outside, typename ColumnTop>
+    void copyPaddedSection(int sx, int sy, int sz, PaddedSection &out,
+                           Outside &&outside, ColumnTop &&columnTop) const {
+        out.fill(EMPTY);
+        int x0 = sx << 4, y0 = sy << 4, z0 = sz << 4;
+        for (int z = -1; z <= 16; z++) {
+            for (int x = -1; x <= 16; x++) {
+                int wx = x0 + x, wz = z0 + z;
+                bool columnInside = contains(wx, 0, wz);
+                int top = columnInside ? std::min<int>(SY, columnTop(wx, wz)) : SY;
+                for (int y = -1; y <= 16; y++) {
+                    int wy = y0 + y;
+                    if (columnInside && contains(wx, wy, wz)) {
+                        if (wy < top) {
+                            out[paddedIndex(x, y, z)] = m_blocks.get(wx, wy, wz);
+                        }
+                    } else {
+                        out[paddedIndex(x, y, z)] = outside(wx, wy, wz);
+                    }
+                }
+            }
+        }
+    }
+    template <typename Outside>
+    void copyPaddedSection(int sx, int sy, int sz, PaddedSection &out, Outside &&outside) const {
+        copyPaddedSection(sx, sy, sz, out, outside, [](int, int) { return SY; });
+    }
+};
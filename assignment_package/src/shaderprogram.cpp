@@ -1,16 +1,19 @@
 #include "shaderprogram.h"
+#include "scene/chunk.h"
 #include <QFile>
 #include <QStringBuilder>
 #include <QTextStream>
 #include <QDebug>
+#include <algorithm>
 #include <stdexcept>
 
 
 ShaderProgram::ShaderProgram(OpenGLContext *context)
     : vertShader(), fragShader(), prog(),
-      attrPos(-1), attrNor(-1), attrCol(-1), attrUV(-1),
+      attrPos(-1), attrNor(-1), attrCol(-1), attrUV(-1), attrPacked(-1),
       unifModel(-1), unifModelInvTr(-1), unifViewProj(-1), unifColor(-1),
       unifTexuture2D(-1), unifNormal2D(-1), unifTime(-1), unifSun(-1), unifPlayer(-1),
+      unifNoiseBackend(-1), unifSeed(-1),
       unifDimensions(-1), unifEye(-1),
       context(context)
 {}
@@ -69,6 +72,7 @@ void ShaderProgram::create(const char *vertfile, const char *fragfile)
     if(attrCol == -1) attrCol = context->glGetAttribLocation(prog, "vs_ColInstanced");
     attrPosOffset = context->glGetAttribLocation(prog, "vs_OffsetInstanced");
     attrUV  = context->glGetAttribLocation(prog, "vs_UV");
+    attrPacked = context->glGetAttribLocation(prog, "vs_Packed");
 
     unifModel      = context->glGetUniformLocation(prog, "u_Model");
     unifModelInvTr = context->glGetUniformLocation(prog, "u_ModelInvTr");
@@ -77,6 +81,8 @@ void ShaderProgram::create(const char *vertfile, const char *fragfile)
     unifTime       = context->glGetUniformLocation(prog, "u_Time");
     unifSun        = context->glGetUniformLocation(prog, "u_Sun");
     unifPlayer     = context->glGetUniformLocation(prog, "u_Player");
+    unifNoiseBackend = context->glGetUniformLocation(prog, "u_NoiseBackend");
+    unifSeed       = context->glGetUniformLocation(prog, "u_Seed");
 
     unifTexuture2D = context->glGetUniformLocation(prog, "u_Texture");
     unifNormal2D   = context->glGetUniformLocation(prog, "u_Normal");
@@ -179,6 +185,20 @@ void ShaderProgram::setPlayer(glm::vec3 player)
     }
 }
 
+void ShaderProgram::setNoise(int backend, uint32_t seed)
+{
+    useMe();
+
+    if(unifNoiseBackend != -1)
+    {
+        context->glUniform1i(unifNoiseBackend, backend);
+    }
+    if(unifSeed != -1)
+    {
+        context->glUniform1ui(unifSeed, seed);
+    }
+}
+
 //This function, as its name implies, uses the passed in GL widget
 void ShaderProgram::draw(Drawable &d, bool alpha)
 {
@@ -202,42 +222,12 @@ void ShaderProgram::draw(Drawable &d, bool alpha)
     // If so, it binds the appropriate buffers to each attribute.
 
     if (!alpha && d.elemCount(false) > 0 && d.bindInter()) {
-        if (attrPos != -1) {
-            context->glEnableVertexAttribArray(attrPos);
-            context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)0);
-        }
-        if (attrNor != -1) {
-            context->glEnableVertexAttribArray(attrNor);
-            context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(sizeof(glm::vec4)));
-        }
-        if (attrCol != -1) {
-            context->glEnableVertexAttribArray(attrCol);
-            context->glVertexAttribPointer(attrCol, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(2 * sizeof(glm::vec4)));
-        }
-        if (attrUV != -1) {
-            context->glEnableVertexAttribArray(attrUV);
-            context->glVertexAttribPointer(attrUV, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(3 * sizeof(glm::vec4)));
-        }
+        setInterleavedAttributes();
         d.bindIdx();
         context->glDrawElements(d.drawMode(), d.elemCount(false), GL_UNSIGNED_INT, 0);
     }
     if (alpha && d.elemCount(true) > 0 && d.bindInterTrans()) {
-        if (attrPos != -1) {
-            context->glEnableVertexAttribArray(attrPos);
-            context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)0);
-        }
-        if (attrNor != -1) {
-            context->glEnableVertexAttribArray(attrNor);
-            context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(sizeof(glm::vec4)));
-        }
-        if (attrCol != -1) {
-            context->glEnableVertexAttribArray(attrCol);
-            context->glVertexAttribPointer(attrCol, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(2 * sizeof(glm::vec4)));
-        }
-        if (attrUV != -1) {
-            context->glEnableVertexAttribArray(attrUV);
-            context->glVertexAttribPointer(attrUV, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(3 * sizeof(glm::vec4)));
-        }
+        setInterleavedAttributes();
         d.bindIdxTrans();
         context->glDrawElements(d.drawMode(), d.elemCount(true), GL_UNSIGNED_INT, 0);
     }
@@ -253,10 +243,65 @@ void ShaderProgram::draw(Drawable &d, bool alpha)
     if (attrNor != -1) context->glDisableVertexAttribArray(attrNor);
     if (attrCol != -1) context->glDisableVertexAttribArray(attrCol);
     if (attrUV  != -1) context->glDisableVertexAttribArray(attrUV);
+    if (attrPacked != -1) context->glDisableVertexAttribArray(attrPacked);
 
     context->printGLErrorLog();
 }
 
+void ShaderProgram::drawMulti(GLuint vertexBuffer, const MultiDrawCommands &commands)
+{
+    useMe();
+
+    if(unifTexuture2D != -1) {
+        context->glUniform1i(unifTexuture2D, 0);
+    }
+    if(unifNormal2D != -1) {
+        context->glUniform1i(unifNormal2D, 1);
+    }
+
+    if (commands.empty()) {
+        return;
+    }
+    context->glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    setInterleavedAttributes();
+    context->bindQuadIndexBuffer((commands.indexEnd + 5) / 6);
+    context->glMultiDrawElementsBaseVertex(GL_TRIANGLES, commands.counts.data(), GL_UNSIGNED_INT,
+                                           commands.offsets.data(), commands.counts.size(),
+                                           commands.baseVertices.data());
+    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
+    if (attrNor != -1) context->glDisableVertexAttribArray(attrNor);
+    if (attrCol != -1) context->glDisableVertexAttribArray(attrCol);
+    if (attrUV  != -1) context->glDisableVertexAttribArray(attrUV);
+    if (attrPacked != -1) context->glDisableVertexAttribArray(attrPacked);
+}
+
+void ShaderProgram::setInterleavedAttributes()
+{
+    if (attrPacked != -1) {
+        // Integer attribute, so it must go through glVertexAttribIPointer
+        // to reach the shader without being converted to float
+        context->glEnableVertexAttribArray(attrPacked);
+        context->glVertexAttribIPointer(attrPacked, 2, GL_UNSIGNED_INT, sizeof(ChunkVertex), (void*)0);
+        return;
+    }
+    if (attrPos != -1) {
+        context->glEnableVertexAttribArray(attrPos);
+        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)0);
+    }
+    if (attrNor != -1) {
+        context->glEnableVertexAttribArray(attrNor);
+        context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(sizeof(glm::vec4)));
+    }
+    if (attrCol != -1) {
+        context->glEnableVertexAttribArray(attrCol);
+        context->glVertexAttribPointer(attrCol, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(2 * sizeof(glm::vec4)));
+    }
+    if (attrUV != -1) {
+        context->glEnableVertexAttribArray(attrUV);
+        context->glVertexAttribPointer(attrUV, 4, GL_FLOAT, false, 4 * sizeof(glm::vec4), (void*)(3 * sizeof(glm::vec4)));
+    }
+}
+
 void ShaderProgram::drawSky(Drawable &d)
 {
         useMe();
@@ -429,3 +474,24 @@ void ShaderProgram::printLinkInfoLog(int prog)
         delete [] infoLog;
     }
 }
+
+void MultiDrawCommands::add(GLsizei count, size_t firstIndex, GLint baseVertex)
+{
+    counts.push_back(count);
+    offsets.push_back(reinterpret_cast<const void*>(firstIndex * sizeof(GLuint)));
+    baseVertices.push_back(baseVertex);
+    indexEnd = std::max(indexEnd, firstIndex + count);
+}
+
+void MultiDrawCommands::clear()
+{
+    counts.clear();
+    offsets.clear();
+    baseVertices.clear();
+    indexEnd = 0;
+}
+
+bool MultiDrawCommands::empty() const
+{
+    return counts.empty();
+}
@@ -6,6 +6,22 @@
 #include <glm/glm.hpp>
 
 #include "drawable.h"
+#include <vector>
+
+// The draws of one glMultiDrawElementsBaseVertex call: draw i reads
+// counts[i] indices from byte offset offsets[i] of the index buffer and
+// adds baseVertices[i] to each
+struct MultiDrawCommands {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+    // One past the last index any draw reads
+    size_t indexEnd = 0;
+
+    void add(GLsizei count, size_t firstIndex, GLint baseVertex);
+    void clear();
+    bool empty() const;
+};
 
 
 class ShaderProgram
@@ -20,6 +36,7 @@ public:
     int attrCol; // A handle for the "in" vec4 representing vertex color in the vertex shader
     int attrPosOffset; // A handle for a vec3 used only in the instanced rendering shader
     int attrUV; // A handle for the "in" vec2 representing vertex UV in the vertex shader
+    int attrPacked; // A handle for the "in" uvec2 holding a packed ChunkVertex in the vertex shader
 
     int unifModel; // A handle for the "uniform" mat4 representing model matrix in the vertex shader
     int unifModelInvTr; // A handle for the "uniform" mat4 representing inverse transpose of the model matrix in the vertex shader
@@ -28,6 +45,8 @@ public:
     int unifTime;
     int unifSun;
     int unifPlayer;
+    int unifNoiseBackend;
+    int unifSeed;
     // Sky
     int unifDimensions;
     int unifEye;
@@ -53,8 +72,16 @@ public:
     void setSun(glm::vec3 sun);
     // Pass the given player position to this shader on the GPU
     void setPlayer(glm::vec3 player);
+    // Pass the world's NoiseBackend and seed to this shader on the GPU, so
+    // its noise hashes lattice points the same way as terrain generation
+    void setNoise(int backend, uint32_t seed);
     // Draw the given object to our screen using this ShaderProgram's shaders
     void draw(Drawable &d, bool alpha);
+    // Draw the commands' ranges of the shared quad index buffer over the
+    // packed ChunkVertex quads in vertexBuffer, in a single draw call.
+    // Doesn't check for GL errors, since it runs once per arena page; the
+    // caller does after the last one.
+    void drawMulti(GLuint vertexBuffer, const MultiDrawCommands &commands);
     // unmodified version of draw function, used to draw sky
     void drawSky(Drawable &d);
     // Draw the given object to our screen multiple times using instanced rendering
@@ -69,6 +96,10 @@ public:
     QString qTextFileRead(const char*);
 
 private:
+    // Points this shader's vertex attributes at the currently bound interleaved buffer,
+    // either packed ChunkVertex data or four vec4s (position, normal, color, UV) per vertex
+    void setInterleavedAttributes();
+
     OpenGLContext* context;   // Since Qt's OpenGL support is done through classes like QOpenGLFunctions_3_2_Core,
                             // we need to pass our OpenGL context to the Drawable in order to call GL functions
                             // from within this class.
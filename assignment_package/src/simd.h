@@ -0,0 +1,272 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Small wrappers over the widest vector registers the compiler targets, so
+// that code like the terrain noise can be written once and run on several
+// values at a time:
+//   AVX2 (-mavx2, -march=native or /arch:AVX2): 8 lanes
+//   SSE2 (every x86-64 build):                   4 lanes
+//   anything else, or SIMD_ENABLED=0:            1 lane
+// vfloat holds SIMD_LANES floats, vdouble the same number of doubles,
+// split over two registers, and vuint the same number of 32-bit unsigned
+// integers, whose arithmetic wraps around like uint32_t's. Every operation is the plain IEEE operation
+// on each lane, so lane i gives exactly what scalar float or double code
+// would, as long as the compiler doesn't fuse multiplies and adds (the
+// project builds with -ffp-contract=off for that reason).
+#ifndef SIMD_ENABLED
+#define SIMD_ENABLED 1
+#endif
+
+#if SIMD_ENABLED && defined(__AVX2__)
+#define SIMD_AVX2 1
+#define SIMD_LANES 8
+#include <immintrin.h>
+#elif SIMD_ENABLED && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIMD_SSE2 1
+#define SIMD_LANES 4
+#include <emmintrin.h>
+#else
+#define SIMD_LANES 1
+#endif
+
+#if SIMD_AVX2
+
+struct vfloat {
+    __m256 v;
+    vfloat() : v(_mm256_setzero_ps()) {}
+    vfloat(float f) : v(_mm256_set1_ps(f)) {}
+    explicit vfloat(__m256 m) : v(m) {}
+    static vfloat load(const float *p) { return vfloat(_mm256_loadu_ps(p)); }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+};
+struct vdouble {
+    __m256d lo, hi; // lanes 0-3 and 4-7
+    vdouble() : lo(_mm256_setzero_pd()), hi(_mm256_setzero_pd()) {}
+    vdouble(double d) : lo(_mm256_set1_pd(d)), hi(_mm256_set1_pd(d)) {}
+    vdouble(__m256d l, __m256d h) : lo(l), hi(h) {}
+};
+struct vuint {
+    __m256i v;
+    vuint() : v(_mm256_setzero_si256()) {}
+    vuint(uint32_t u) : v(_mm256_set1_epi32(static_cast<int>(u))) {}
+    explicit vuint(__m256i m) : v(m) {}
+};
+// All bits set in the lanes where a comparison held
+struct vmask {
+    __m256 m;
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return vfloat(_mm256_add_ps(a.v, b.v)); }
+inline vfloat operator-(vfloat a, vfloat b) { return vfloat(_mm256_sub_ps(a.v, b.v)); }
+inline vfloat operator*(vfloat a, vfloat b) { return vfloat(_mm256_mul_ps(a.v, b.v)); }
+inline vfloat operator/(vfloat a, vfloat b) { return vfloat(_mm256_div_ps(a.v, b.v)); }
+inline vmask operator<(vfloat a, vfloat b) { return vmask{_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline vfloat floor(vfloat a) { return vfloat(_mm256_floor_ps(a.v)); }
+inline vfloat abs(vfloat a) { return vfloat(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v)); }
+inline vfloat sqrt(vfloat a) { return vfloat(_mm256_sqrt_ps(a.v)); }
+// Lanes of a where m is set, lanes of b elsewhere
+inline vfloat select(vmask m, vfloat a, vfloat b) { return vfloat(_mm256_blendv_ps(b.v, a.v, m.m)); }
+// 0, 1, 2, ... SIMD_LANES - 1
+inline vfloat laneIndex() { return vfloat(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)); }
+
+inline vdouble operator+(vdouble a, vdouble b) { return {_mm256_add_pd(a.lo, b.lo), _mm256_add_pd(a.hi, b.hi)}; }
+inline vdouble operator-(vdouble a, vdouble b) { return {_mm256_sub_pd(a.lo, b.lo), _mm256_sub_pd(a.hi, b.hi)}; }
+inline vdouble operator*(vdouble a, vdouble b) { return {_mm256_mul_pd(a.lo, b.lo), _mm256_mul_pd(a.hi, b.hi)}; }
+inline vdouble operator/(vdouble a, vdouble b) { return {_mm256_div_pd(a.lo, b.lo), _mm256_div_pd(a.hi, b.hi)}; }
+inline vdouble min(vdouble a, vdouble b) { return {_mm256_min_pd(a.lo, b.lo), _mm256_min_pd(a.hi, b.hi)}; }
+inline vdouble max(vdouble a, vdouble b) { return {_mm256_max_pd(a.lo, b.lo), _mm256_max_pd(a.hi, b.hi)}; }
+
+inline vdouble toDouble(vfloat a) {
+    return {_mm256_cvtps_pd(_mm256_castps256_ps128(a.v)), _mm256_cvtps_pd(_mm256_extractf128_ps(a.v, 1))};
+}
+inline vfloat toFloat(vdouble a) {
+    return vfloat(_mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(a.lo)), _mm256_cvtpd_ps(a.hi), 1));
+}
+
+inline vuint operator+(vuint a, vuint b) { return vuint(_mm256_add_epi32(a.v, b.v)); }
+inline vuint operator*(vuint a, vuint b) { return vuint(_mm256_mullo_epi32(a.v, b.v)); }
+inline vuint operator^(vuint a, vuint b) { return vuint(_mm256_xor_si256(a.v, b.v)); }
+inline vuint operator|(vuint a, vuint b) { return vuint(_mm256_or_si256(a.v, b.v)); }
+inline vuint operator<<(vuint a, int n) { return vuint(_mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n))); }
+inline vuint operator>>(vuint a, int n) { return vuint(_mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n))); }
+// Converts lanes that already hold integers, like the result of floor()
+inline vuint toUint(vfloat a) { return vuint(_mm256_cvttps_epi32(a.v)); }
+// Exact for values below 2^24
+inline vfloat toFloat(vuint a) { return vfloat(_mm256_cvtepi32_ps(a.v)); }
+
+#elif SIMD_SSE2
+
+struct vfloat {
+    __m128 v;
+    vfloat() : v(_mm_setzero_ps()) {}
+    vfloat(float f) : v(_mm_set1_ps(f)) {}
+    explicit vfloat(__m128 m) : v(m) {}
+    static vfloat load(const float *p) { return vfloat(_mm_loadu_ps(p)); }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+};
+struct vdouble {
+    __m128d lo, hi; // lanes 0-1 and 2-3
+    vdouble() : lo(_mm_setzero_pd()), hi(_mm_setzero_pd()) {}
+    vdouble(double d) : lo(_mm_set1_pd(d)), hi(_mm_set1_pd(d)) {}
+    vdouble(__m128d l, __m128d h) : lo(l), hi(h) {}
+};
+struct vuint {
+    __m128i v;
+    vuint() : v(_mm_setzero_si128()) {}
+    vuint(uint32_t u) : v(_mm_set1_epi32(static_cast<int>(u))) {}
+    explicit vuint(__m128i m) : v(m) {}
+};
+// All bits set in the lanes where a comparison held
+struct vmask {
+    __m128 m;
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return vfloat(_mm_add_ps(a.v, b.v)); }
+inline vfloat operator-(vfloat a, vfloat b) { return vfloat(_mm_sub_ps(a.v, b.v)); }
+inline vfloat operator*(vfloat a, vfloat b) { return vfloat(_mm_mul_ps(a.v, b.v)); }
+inline vfloat operator/(vfloat a, vfloat b) { return vfloat(_mm_div_ps(a.v, b.v)); }
+inline vmask operator<(vfloat a, vfloat b) { return vmask{_mm_cmplt_ps(a.v, b.v)}; }
+// SSE2 has no rounding instruction: truncate, then step down where that
+// rounded up. Only valid for |a| < 2^31, far beyond any world coordinate.
+inline vfloat floor(vfloat a) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    return vfloat(_mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.f))));
+}
+inline vfloat abs(vfloat a) { return vfloat(_mm_andnot_ps(_mm_set1_ps(-0.f), a.v)); }
+inline vfloat sqrt(vfloat a) { return vfloat(_mm_sqrt_ps(a.v)); }
+// Lanes of a where m is set, lanes of b elsewhere
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+    return vfloat(_mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)));
+}
+// 0, 1, 2, ... SIMD_LANES - 1
+inline vfloat laneIndex() { return vfloat(_mm_setr_ps(0, 1, 2, 3)); }
+
+inline vdouble operator+(vdouble a, vdouble b) { return {_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)}; }
+inline vdouble operator-(vdouble a, vdouble b) { return {_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)}; }
+inline vdouble operator*(vdouble a, vdouble b) { return {_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)}; }
+inline vdouble operator/(vdouble a, vdouble b) { return {_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)}; }
+inline vdouble min(vdouble a, vdouble b) { return {_mm_min_pd(a.lo, b.lo), _mm_min_pd(a.hi, b.hi)}; }
+inline vdouble max(vdouble a, vdouble b) { return {_mm_max_pd(a.lo, b.lo), _mm_max_pd(a.hi, b.hi)}; }
+
+inline vdouble toDouble(vfloat a) {
+    return {_mm_cvtps_pd(a.v), _mm_cvtps_pd(_mm_movehl_ps(a.v, a.v))};
+}
+inline vfloat toFloat(vdouble a) {
+    return vfloat(_mm_movelh_ps(_mm_cvtpd_ps(a.lo), _mm_cvtpd_ps(a.hi)));
+}
+
+inline vuint operator+(vuint a, vuint b) { return vuint(_mm_add_epi32(a.v, b.v)); }
+// SSE2 only multiplies lanes 0 and 2 into 64 bits: do the odd lanes
+// separately and keep the low halves of all four
+inline vuint operator*(vuint a, vuint b) {
+    __m128i even = _mm_mul_epu32(a.v, b.v);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+    return vuint(_mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))));
+}
+inline vuint operator^(vuint a, vuint b) { return vuint(_mm_xor_si128(a.v, b.v)); }
+inline vuint operator|(vuint a, vuint b) { return vuint(_mm_or_si128(a.v, b.v)); }
+inline vuint operator<<(vuint a, int n) { return vuint(_mm_sll_epi32(a.v, _mm_cvtsi32_si128(n))); }
+inline vuint operator>>(vuint a, int n) { return vuint(_mm_srl_epi32(a.v, _mm_cvtsi32_si128(n))); }
+// Converts lanes that already hold integers, like the result of floor()
+inline vuint toUint(vfloat a) { return vuint(_mm_cvttps_epi32(a.v)); }
+// Exact for values below 2^24
+inline vfloat toFloat(vuint a) { return vfloat(_mm_cvtepi32_ps(a.v)); }
+
+#else
+
+struct vfloat {
+    float v;
+    vfloat() : v(0.f) {}
+    vfloat(float f) : v(f) {}
+    static vfloat load(const float *p) { return vfloat(*p); }
+    void store(float *p) const { *p = v; }
+};
+struct vdouble {
+    double v;
+    vdouble() : v(0.0) {}
+    vdouble(double d) : v(d) {}
+};
+struct vuint {
+    uint32_t v;
+    vuint() : v(0) {}
+    vuint(uint32_t u) : v(u) {}
+};
+struct vmask {
+    bool m;
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return vfloat(a.v + b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return vfloat(a.v - b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return vfloat(a.v * b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return vfloat(a.v / b.v); }
+inline vmask operator<(vfloat a, vfloat b) { return vmask{a.v < b.v}; }
+inline vfloat floor(vfloat a) { return vfloat(std::floor(a.v)); }
+inline vfloat abs(vfloat a) { return vfloat(std::fabs(a.v)); }
+inline vfloat sqrt(vfloat a) { return vfloat(std::sqrt(a.v)); }
+inline vfloat select(vmask m, vfloat a, vfloat b) { return m.m ? a : b; }
+inline vfloat laneIndex() { return vfloat(0.f); }
+
+inline vdouble operator+(vdouble a, vdouble b) { return vdouble(a.v + b.v); }
+inline vdouble operator-(vdouble a, vdouble b) { return vdouble(a.v - b.v); }
+inline vdouble operator*(vdouble a, vdouble b) { return vdouble(a.v * b.v); }
+inline vdouble operator/(vdouble a, vdouble b) { return vdouble(a.v / b.v); }
+inline vdouble min(vdouble a, vdouble b) { return vdouble(b.v < a.v ? b.v : a.v); }
+inline vdouble max(vdouble a, vdouble b) { return vdouble(a.v < b.v ? b.v : a.v); }
+
+inline vdouble toDouble(vfloat a) { return vdouble(a.v); }
+inline vfloat toFloat(vdouble a) { return vfloat(static_cast<float>(a.v)); }
+
+inline vuint operator+(vuint a, vuint b) { return vuint(a.v + b.v); }
+inline vuint operator*(vuint a, vuint b) { return vuint(a.v * b.v); }
+inline vuint operator^(vuint a, vuint b) { return vuint(a.v ^ b.v); }
+inline vuint operator|(vuint a, vuint b) { return vuint(a.v | b.v); }
+inline vuint operator<<(vuint a, int n) { return vuint(a.v << n); }
+inline vuint operator>>(vuint a, int n) { return vuint(a.v >> n); }
+inline vuint toUint(vfloat a) { return vuint(static_cast<uint32_t>(static_cast<int32_t>(a.v))); }
+inline vfloat toFloat(vuint a) { return vfloat(static_cast<float>(static_cast<int32_t>(a.v))); }
+
+#endif
+
+// Built from the operations above, so the same on every backend
+
+// Smaller of a and b in each lane
+inline vfloat min(vfloat a, vfloat b) { return select(b < a, b, a); }
+
+inline vfloat fract(vfloat a) { return a - floor(a); }
+
+// Rounds each lane to the nearest integer, ties to even, for |a| < 2^51:
+// adding 1.5 * 2^52 leaves no bits for the fraction
+inline vdouble nearbyint(vdouble a) {
+    const vdouble magic(6755399441055744.0);
+    return (a + magic) - magic;
+}
+
+// sin() of every lane, computed in double precision and then rounded, so
+// it nearly always equals the correctly rounded std::sin(float). Accurate
+// for |a| up to 2^24 (the largest float that is still an integer step).
+inline vfloat sin(vfloat a) {
+    vdouble x = toDouble(a);
+    // Reduce to r = x - k * pi in [-pi/2, pi/2]; sin(x) = (-1)^k sin(r).
+    // pi is split in three so the first two products are exact for k < 2^23.
+    vdouble k = nearbyint(x * vdouble(0x1.45f306dc9c883p-2));
+    vdouble r = x - k * vdouble(0x1.921fb548p+1);
+    r = r - k * vdouble(-0x1.de973dc8p-30);
+    r = r - k * vdouble(-0x1.9d9cceba3f91fp-61);
+    // 1 - 2 * parity, since k - 2 * nearbyint(k / 2) is +-1 when k is odd
+    vdouble odd = k - vdouble(2.0) * nearbyint(k * vdouble(0.5));
+    vdouble sign = vdouble(1.0) - vdouble(2.0) * odd * odd;
+    // Taylor series to r^17; its error is below 1e-13 on [-pi/2, pi/2]
+    vdouble r2 = r * r;
+    vdouble p(2.8114572543455206e-15);
+    p = p * r2 + vdouble(-7.647163731819816e-13);
+    p = p * r2 + vdouble(1.6059043836821613e-10);
+    p = p * r2 + vdouble(-2.505210838544172e-08);
+    p = p * r2 + vdouble(2.7557319223985893e-06);
+    p = p * r2 + vdouble(-0.0001984126984126984);
+    p = p * r2 + vdouble(0.008333333333333333);
+    p = p * r2 + vdouble(-0.16666666666666666);
+    return toFloat(sign * (r + r * r2 * p));
+}
@@ -20,7 +20,18 @@ SOURCES += \
     $$PWD/scene/camera.cpp \
     $$PWD/playerinfo.cpp \
     $$PWD/scene/chunk.cpp \
-    $$PWD/texture.cpp
+    $$PWD/texture.cpp \
+    $$PWD/jobsystem.cpp \
+    $$PWD/scene/chunkscheduler.cpp \
+    $$PWD/scene/chunkuploadqueue.cpp \
+    $$PWD/scene/regionfile.cpp \
+    $$PWD/scene/noise.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/gputimer.cpp \
+    $$PWD/scene/frustum.cpp \
+    $$PWD/scene/caveculler.cpp \
+    $$PWD/scene/chunkarena.cpp \
+    $$PWD/scene/voxelvolume.cpp
 
 HEADERS += \
     $$PWD/la.h \
@@ -42,4 +53,18 @@ HEADERS += \
     $$PWD/scene/camera.h \
     $$PWD/playerinfo.h \
     $$PWD/scene/chunk.h \
-    $$PWD/texture.h
+    $$PWD/texture.h \
+    $$PWD/jobsystem.h \
+    $$PWD/scene/chunkscheduler.h \
+    $$PWD/scene/chunkuploadqueue.h \
+    $$PWD/scene/regionfile.h \
+    $$PWD/scene/palettedblocks.h \
+    $$PWD/scene/voxelvolume.h \
+    $$PWD/scene/noise.h \
+    $$PWD/simd.h \
+    $$PWD/profiler.h \
+    $$PWD/gputimer.h \
+    $$PWD/scene/frustum.h \
+    $$PWD/scene/caveculler.h \
+    $$PWD/scene/chunkarena.h \
+    $$PWD/scene/chunkkey.h